@@ -1,12 +1,11 @@
 ﻿#include "2048src.h"
 
 // 全局常量定义
-const int MAX_UNDO_STEPS = 64;
-const int BOARD_SIZE = 4;
 const int TARGET = 2048;
 const int CELL_WIDTH = 26;
 const int CELL_HEIGHT = 13;
 bool DEBUG = false;
+AIOptions AI_OPTIONS;
 
 // 全局映射表定义
 std::map<int, int> _2PowerMap = {
@@ -21,14 +20,6 @@ std::map<int, int> _2logMap = {
     {32768,15},{65536,16}
 };
 
-// AIEvaluator静态成员初始化
-array<uint16_t, 65536> AIEvaluator::rowLeftTable;
-array<uint16_t, 65536> AIEvaluator::rowRightTable;
-array<uint64_t, 65536> AIEvaluator::colUpTable;
-array<uint64_t, 65536> AIEvaluator::colDownTable;
-array<float, 65536> AIEvaluator::heurScoreTable;
-array<float, 65536> AIEvaluator::scoreTable;
-
 // ==================== 辅助函数实现 ====================
 
 // 跳过ANSI控制码
@@ -162,17 +153,629 @@ bool KeyboardHandler::hasKeyPressed() {
 #endif
 }
 
+// ==================== WorkStealingPool实现 ====================
+
+thread_local WorkStealingPool* WorkStealingPool::currentPool = nullptr;
+thread_local int WorkStealingPool::currentIndex = -1;
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount) : stopping(false), pendingTasks(0) {
+    for (unsigned i = 0; i <= threadCount; i++) {
+        queues.emplace_back(new WorkerQueue());
+    }
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, static_cast<int>(i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stopping = true;
+    {
+        lock_guard<mutex> lock(sleepMutex);
+    }
+    sleepCv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::submit(function<void()> task) {
+    WorkerQueue& queue = *queues[currentWorkerIndex()];
+    {
+        lock_guard<mutex> lock(queue.m);
+        queue.tasks.push_back(std::move(task));
+    }
+    pendingTasks++;
+    {
+        lock_guard<mutex> lock(sleepMutex);
+    }
+    sleepCv.notify_one();
+}
+
+// 先从自己队列尾部取（LIFO，局部性好），再从其他队列头部窃取（最大的任务）
+bool WorkStealingPool::popTask(int self, function<void()>& task) {
+    {
+        WorkerQueue& own = *queues[self];
+        lock_guard<mutex> lock(own.m);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pendingTasks--;
+            return true;
+        }
+    }
+    size_t n = queues.size();
+    for (size_t k = 1; k < n; k++) {
+        WorkerQueue& victim = *queues[(self + k) % n];
+        lock_guard<mutex> lock(victim.m);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pendingTasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::runPendingTask() {
+    function<void()> task;
+    if (!popTask(currentWorkerIndex(), task)) return false;
+    task();
+    return true;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    currentPool = this;
+    currentIndex = index;
+    while (!stopping) {
+        function<void()> task;
+        if (popTask(index, task)) {
+            task();
+            continue;
+        }
+        unique_lock<mutex> lock(sleepMutex);
+        sleepCv.wait(lock, [this]() { return stopping || pendingTasks > 0; });
+    }
+}
+
+unsigned configuredThreadCount() {
+    unsigned threads = AI_OPTIONS.threads > 0 ? AI_OPTIONS.threads : thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+// ==================== MappedFile实现 ====================
+
+bool MappedFile::open(const string& path) {
+    close();
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!mappingHandle) {
+        close();
+        return false;
+    }
+    base = static_cast<char*>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+    if (!base) {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close();
+        return false;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        close();
+        return false;
+    }
+    base = static_cast<char*>(addr);
+    length = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+}
+
+// 匿名映射的页面由系统保证为零，且在首次访问前不占用物理内存
+bool MappedFile::allocate(size_t size) {
+    close();
+#ifdef _WIN32
+    mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr);
+    if (!mappingHandle) return false;
+    base = static_cast<char*>(MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, size));
+    if (!base) {
+        close();
+        return false;
+    }
+#else
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return false;
+    base = static_cast<char*>(addr);
+#endif
+    length = size;
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (base) munmap(base, length);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+void MappedFile::swap(MappedFile& other) {
+    std::swap(base, other.base);
+    std::swap(length, other.length);
+#ifdef _WIN32
+    std::swap(fileHandle, other.fileHandle);
+    std::swap(mappingHandle, other.mappingHandle);
+#else
+    std::swap(fd, other.fd);
+#endif
+}
+
+// ==================== TranspositionTable实现 ====================
+
+TranspositionTable::TranspositionTable(size_t megabytes) {
+    size_t bucketCount = 1;
+    while (bucketCount * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024) {
+        bucketCount *= 2;
+    }
+    // 新分配的匿名内存已全部为零（即空条目），无需在启动时逐项清空
+    if (!ownedMemory.allocate(bucketCount * sizeof(Bucket))) throw bad_alloc();
+    buckets = reinterpret_cast<Bucket*>(ownedMemory.data());
+    bucketMask = bucketCount - 1;
+    generation = 0;
+}
+
+uint64_t TranspositionTable::packData(int depth, float score, bool upperBound) const {
+    uint32_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    return ENTRY_OCCUPIED | (upperBound ? ENTRY_UPPER_BOUND : 0) | (static_cast<uint64_t>(generation) << 40) |
+        (static_cast<uint64_t>(depth & 0xff) << 32) | bits;
+}
+
+float TranspositionTable::scoreOf(uint64_t data) {
+    uint32_t bits = static_cast<uint32_t>(data);
+    float score;
+    memcpy(&score, &bits, sizeof(score));
+    return score;
+}
+
+bool TranspositionTable::probe(uint64_t board, int depth, float& score, bool& upperBound) {
+    Bucket& bucket = bucketFor(board);
+    for (Entry& entry : bucket.entries) {
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        uint64_t key = entry.key.load(memory_order_relaxed);
+        if ((data & ENTRY_OCCUPIED) && (key ^ data) == board) {
+            if (depthOf(data) < depth) return false;
+            score = scoreOf(data);
+            upperBound = (data & ENTRY_UPPER_BOUND) != 0;
+            if (ageOf(data) != 0) {
+                uint64_t refreshed = packData(depthOf(data), score, upperBound);
+                entry.key.store(board ^ refreshed, memory_order_relaxed);
+                entry.data.store(refreshed, memory_order_relaxed);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t board, int depth, float score, bool upperBound) {
+    Bucket& bucket = bucketFor(board);
+    Entry* victim = nullptr;
+    int victimRank = INT32_MAX;
+
+    for (Entry& entry : bucket.entries) {
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        uint64_t key = entry.key.load(memory_order_relaxed);
+        if (!(data & ENTRY_OCCUPIED)) {
+            victim = &entry;
+            break;
+        }
+        if ((key ^ data) == board) {
+            if (depthOf(data) > depth || (depthOf(data) == depth && upperBound && !(data & ENTRY_UPPER_BOUND))) return;
+            victim = &entry;
+            break;
+        }
+        // 越旧的条目越先被替换，同代中剩余深度小的先被替换
+        int rank = (255 - ageOf(data)) * 256 + depthOf(data);
+        if (rank < victimRank) {
+            victimRank = rank;
+            victim = &entry;
+        }
+    }
+
+    uint64_t data = packData(depth, score, upperBound);
+    victim->key.store(board ^ data, memory_order_relaxed);
+    victim->data.store(data, memory_order_relaxed);
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i <= bucketMask; i++) {
+        for (Entry& entry : buckets[i].entries) {
+            entry.key.store(0, memory_order_relaxed);
+            entry.data.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+// 哈希使条目均匀分布，统计开头的一段桶即可估计整表的占用比例，且只触及少量页面
+double TranspositionTable::sampleOccupancy() const {
+    size_t sampled = min<size_t>(bucketMask + 1, 1024);
+    size_t used = 0;
+    for (size_t i = 0; i < sampled; i++) {
+        for (const Entry& entry : buckets[i].entries) {
+            if (entry.data.load(memory_order_relaxed) & ENTRY_OCCUPIED) used++;
+        }
+    }
+    return static_cast<double>(used) / (sampled * BUCKET_ENTRIES);
+}
+
+// 映射快照文件作为置换表内容，校验失败时保持原表不变
+bool TranspositionTable::loadSnapshot(const string& path, const vector<float>& params) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < TTFileHeader::BUCKET_OFFSET) return false;
+
+    TTFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    size_t bucketCount = bucketMask + 1;
+    if (memcmp(header.magic, "2048TT", 7) != 0 ||
+        header.version != TTFileHeader::VERSION ||
+        header.bucketSize != sizeof(Bucket) ||
+        header.bucketCount != bucketCount ||
+        header.paramCount != params.size() ||
+        memcmp(header.params, params.data(), params.size() * sizeof(float)) != 0 ||
+        file.size() != TTFileHeader::BUCKET_OFFSET + bucketCount * sizeof(Bucket)) {
+        return false;
+    }
+
+    mapping.swap(file);
+    buckets = reinterpret_cast<Bucket*>(mapping.data() + TTFileHeader::BUCKET_OFFSET);
+    ownedMemory.close();
+    generation = static_cast<uint8_t>(header.generation);
+    return true;
+}
+
+// 先写临时文件再替换，避免进程中途退出留下损坏的快照
+bool TranspositionTable::saveSnapshot(const string& path, const vector<float>& params) {
+    if (params.size() > TTFileHeader::MAX_PARAMS) return false;
+    size_t bucketCount = bucketMask + 1;
+
+    // 当前内容来自同一文件的映射时，先复制到堆内存再解除映射（Windows不允许替换已映射的文件）
+    if (mapping.isOpen()) {
+        if (!ownedMemory.allocate(bucketCount * sizeof(Bucket))) return false;
+        memcpy(ownedMemory.data(), buckets, bucketCount * sizeof(Bucket));
+        buckets = reinterpret_cast<Bucket*>(ownedMemory.data());
+        mapping.close();
+    }
+
+    TTFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "2048TT", 7);
+    header.version = TTFileHeader::VERSION;
+    header.bucketSize = sizeof(Bucket);
+    header.bucketCount = bucketCount;
+    header.generation = generation;
+    header.paramCount = static_cast<uint32_t>(params.size());
+    memcpy(header.params, params.data(), params.size() * sizeof(float));
+
+    string tmpPath = path + ".tmp";
+    {
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out) return false;
+        char padded[TTFileHeader::BUCKET_OFFSET] = {};
+        memcpy(padded, &header, sizeof(header));
+        out.write(padded, sizeof(padded));
+        out.write(reinterpret_cast<const char*>(buckets), bucketCount * sizeof(Bucket));
+        if (!out) return false;
+    }
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// ==================== NTupleNetwork实现 ====================
+
+vector<vector<int>> NTupleNetwork::defaultPatterns() {
+    return {
+        { 0, 1, 2, 3, 4, 5 },
+        { 4, 5, 6, 7, 8, 9 },
+        { 0, 1, 2, 4, 5, 6 },
+        { 4, 5, 6, 8, 9, 10 }
+    };
+}
+
+bool NTupleNetwork::validPattern(const vector<int>& cells) {
+    if (cells.empty() || cells.size() > NTupleFileHeader::MAX_CELLS) return false;
+    int used = 0;
+    for (int cell : cells) {
+        if (cell < 0 || cell > 15 || (used & (1 << cell))) return false;
+        used |= 1 << cell;
+    }
+    return true;
+}
+
+static uint32_t weightsChecksum(const vector<float>& weights) {
+    uint32_t hash = 2166136261u;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(weights.data());
+    for (size_t i = 0; i < weights.size() * sizeof(float); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool NTupleNetwork::create(const vector<vector<int>>& patterns) {
+    size_t total = 0;
+    for (const auto& cells : patterns) {
+        if (!validPattern(cells)) return false;
+        total += size_t(1) << (4 * cells.size());
+    }
+
+    MappedFile memory;
+    if (patterns.empty() || !memory.allocate(total * sizeof(float))) return false;
+
+    vector<Tuple> created;
+    atomic<float>* weights = reinterpret_cast<atomic<float>*>(memory.data());
+    for (const auto& cells : patterns) {
+        size_t size = size_t(1) << (4 * cells.size());
+        created.push_back({ cells, weights, size });
+        weights += size;
+    }
+
+    mapping.swap(memory);
+    tuples.swap(created);
+    fileBacked = false;
+    checksumValue = 0;
+    return true;
+}
+
+// 映射权重文件，校验失败时保持原网络不变
+bool NTupleNetwork::load(const string& path) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(NTupleFileHeader)) return false;
+
+    NTupleFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, "2048NT", 7) != 0 ||
+        header.version != NTupleFileHeader::VERSION ||
+        header.tupleCount == 0 || header.tupleCount > 64) {
+        return false;
+    }
+
+    size_t offset = sizeof(NTupleFileHeader) + header.tupleCount * sizeof(NTupleFileTuple);
+    if (file.size() < offset) return false;
+
+    vector<Tuple> loaded;
+    const char* desc = file.data() + sizeof(NTupleFileHeader);
+    for (uint32_t t = 0; t < header.tupleCount; t++) {
+        NTupleFileTuple fileTuple;
+        memcpy(&fileTuple, desc + t * sizeof(NTupleFileTuple), sizeof(fileTuple));
+        if (fileTuple.cellCount == 0 || fileTuple.cellCount > NTupleFileHeader::MAX_CELLS) return false;
+
+        vector<int> cells(fileTuple.cells, fileTuple.cells + fileTuple.cellCount);
+        if (!validPattern(cells)) return false;
+        size_t size = size_t(1) << (4 * cells.size());
+        if (file.size() < offset + size * sizeof(float)) return false;
+        loaded.push_back({ cells, reinterpret_cast<atomic<float>*>(file.data() + offset), size });
+        offset += size * sizeof(float);
+    }
+    if (file.size() != offset) return false;
+
+    mapping.swap(file);
+    tuples.swap(loaded);
+    fileBacked = true;
+    checksumValue = header.checksum;
+    return true;
+}
+
+// 先写临时文件再替换，与置换表快照相同。训练线程可能同时在更新权重，
+// 所以先把权重复制一份，校验和与写出的内容都取自这份副本
+bool NTupleNetwork::save(const string& path) {
+    if (tuples.empty()) return false;
+
+    // 权重映射自文件时先复制到匿名内存（Windows不允许替换已映射的文件）
+    if (fileBacked) {
+        MappedFile memory;
+        if (!memory.allocate(mapping.size())) return false;
+        memcpy(memory.data(), mapping.data(), mapping.size());
+        ptrdiff_t delta = memory.data() - mapping.data();
+        for (auto& tuple : tuples) {
+            tuple.weights = reinterpret_cast<atomic<float>*>(reinterpret_cast<char*>(tuple.weights) + delta);
+        }
+        mapping.swap(memory);
+        fileBacked = false;
+    }
+
+    NTupleFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "2048NT", 7);
+    header.version = NTupleFileHeader::VERSION;
+    header.tupleCount = static_cast<uint32_t>(tuples.size());
+
+    vector<float> weights;
+    weights.reserve(mapping.size() / sizeof(float));
+    for (const auto& tuple : tuples) {
+        for (size_t i = 0; i < tuple.size; i++) weights.push_back(tuple.weights[i].load(memory_order_relaxed));
+    }
+    header.checksum = weightsChecksum(weights);
+
+    string tmpPath = path + ".tmp";
+    {
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& tuple : tuples) {
+            NTupleFileTuple fileTuple;
+            memset(&fileTuple, 0, sizeof(fileTuple));
+            fileTuple.cellCount = static_cast<uint32_t>(tuple.cells.size());
+            for (size_t i = 0; i < tuple.cells.size(); i++) fileTuple.cells[i] = tuple.cells[i];
+            out.write(reinterpret_cast<const char*>(&fileTuple), sizeof(fileTuple));
+        }
+        out.write(reinterpret_cast<const char*>(weights.data()), weights.size() * sizeof(float));
+        if (!out) return false;
+    }
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) return false;
+    checksumValue = header.checksum;
+    return true;
+}
+
+void NTupleNetwork::symmetries(uint64_t board, uint64_t out[8]) {
+    uint64_t t = AIEvaluator::transpose(board);
+    out[0] = board;
+    out[1] = AIEvaluator::flipHorizontal(board);
+    out[2] = AIEvaluator::flipVertical(board);
+    out[3] = AIEvaluator::flipVertical(out[1]);
+    out[4] = t;
+    out[5] = AIEvaluator::flipHorizontal(t);
+    out[6] = AIEvaluator::flipVertical(t);
+    out[7] = AIEvaluator::flipVertical(out[5]);
+}
+
+float NTupleNetwork::evaluate(uint64_t board) const {
+    uint64_t syms[8];
+    symmetries(board, syms);
+
+    float sum = 0.0f;
+    for (const auto& tuple : tuples) {
+        for (uint64_t sym : syms) {
+            size_t index = 0;
+            for (size_t i = 0; i < tuple.cells.size(); i++) {
+                index |= static_cast<size_t>((sym >> (4 * tuple.cells[i])) & 0xf) << (4 * i);
+            }
+            sum += tuple.weights[index].load(memory_order_relaxed);
+        }
+    }
+    return sum;
+}
+
+void NTupleNetwork::update(uint64_t board, float delta) {
+    uint64_t syms[8];
+    symmetries(board, syms);
+
+    for (auto& tuple : tuples) {
+        for (uint64_t sym : syms) {
+            size_t index = 0;
+            for (size_t i = 0; i < tuple.cells.size(); i++) {
+                index |= static_cast<size_t>((sym >> (4 * tuple.cells[i])) & 0xf) << (4 * i);
+            }
+            atomic<float>& weight = tuple.weights[index];
+            weight.store(weight.load(memory_order_relaxed) + delta, memory_order_relaxed);
+        }
+    }
+}
+
+shared_ptr<const NTupleNetwork> sharedNTupleNetwork() {
+    static once_flag loaded;
+    static shared_ptr<const NTupleNetwork> network;
+    call_once(loaded, []() {
+        if (AI_OPTIONS.ntupleFile.empty()) return;
+        auto net = make_shared<NTupleNetwork>();
+        if (net->load(AI_OPTIONS.ntupleFile)) network = net;
+    });
+    return network;
+}
+
+// ==================== HeuristicWeights实现 ====================
+
+static const pair<const char*, float HeuristicWeights::*> HEURISTIC_WEIGHT_NAMES[] = {
+    { "lost_penalty", &HeuristicWeights::lostPenalty },
+    { "monotonicity_power", &HeuristicWeights::monotonicityPower },
+    { "monotonicity_weight", &HeuristicWeights::monotonicityWeight },
+    { "sum_power", &HeuristicWeights::sumPower },
+    { "sum_weight", &HeuristicWeights::sumWeight },
+    { "merges_weight", &HeuristicWeights::mergesWeight },
+    { "empty_weight", &HeuristicWeights::emptyWeight }
+};
+
+bool HeuristicWeights::load(const string& path) {
+    ifstream in(path);
+    if (!in) return false;
+
+    HeuristicWeights loaded = *this;
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string name;
+        float value;
+        if (!(fields >> name) || name[0] == '#') continue;
+        if (!(fields >> value)) return false;
+
+        bool known = false;
+        for (const auto& entry : HEURISTIC_WEIGHT_NAMES) {
+            if (name == entry.first) {
+                loaded.*entry.second = value;
+                known = true;
+            }
+        }
+        if (!known) return false;
+    }
+
+    *this = loaded;
+    return true;
+}
+
+bool HeuristicWeights::save(const string& path) const {
+    ofstream out(path, ios::trunc);
+    if (!out) return false;
+    out << toString();
+    return static_cast<bool>(out);
+}
+
+string HeuristicWeights::toString() const {
+    ostringstream out;
+    out << setprecision(9);
+    for (const auto& entry : HEURISTIC_WEIGHT_NAMES) {
+        out << entry.first << " " << this->*entry.second << "\n";
+    }
+    return out.str();
+}
+
+bool HeuristicWeights::operator==(const HeuristicWeights& other) const {
+    for (const auto& entry : HEURISTIC_WEIGHT_NAMES) {
+        if (this->*entry.second != other.*entry.second) return false;
+    }
+    return true;
+}
+
 // ==================== AIEvaluator实现 ====================
 
-uint16_t AIEvaluator::reverseRow(uint16_t row) {
-    return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12);
+AIEvaluator::AIEvaluator(WorkStealingPool* searchPool, size_t ttMegabytes) :
+    AIEvaluator(searchPool, make_shared<TranspositionTable>(ttMegabytes)) {
 }
 
-uint64_t AIEvaluator::unpackCol(uint16_t row) {
-    uint64_t tmp = row;
-    return (tmp | (tmp << 12ULL) | (tmp << 24ULL) | (tmp << 36ULL)) & 0x000F000F000F000FULL;
+AIEvaluator::AIEvaluator(WorkStealingPool* searchPool, shared_ptr<TranspositionTable> table) :
+    transTable(table ? std::move(table) : make_shared<TranspositionTable>(AI_OPTIONS.ttMegabytes)), network(sharedNTupleNetwork()), heurTable(heurScoreTable.data()),
+    heurUpperBound(HEUR_UPPER_BOUND), pool(searchPool), statNodes(0), statCacheprobes(0), statCachehits(0), statMaxdepth(0),
+    statDepthLimited(false), aborted(false), cancelFlag(nullptr), limitsActive(false) {
+    if (!(AI_OPTIONS.weights == DEFAULT_WEIGHTS)) buildHeuristicTable(AI_OPTIONS.weights);
 }
 
+
 uint64_t AIEvaluator::transpose(uint64_t x) {
     uint64_t a1 = x & 0xF0F00F0FF0F00F0FULL;
     uint64_t a2 = x & 0x0000F0F00000F0F0ULL;
@@ -184,6 +787,26 @@ uint64_t AIEvaluator::transpose(uint64_t x) {
     return b1 | (b2 >> 24) | (b3 << 24);
 }
 
+// 每行内的四个格子左右翻转
+uint64_t AIEvaluator::flipHorizontal(uint64_t x) {
+    return ((x & 0x000F000F000F000FULL) << 12) | ((x & 0x00F000F000F000F0ULL) << 4) |
+        ((x & 0x0F000F000F000F00ULL) >> 4) | ((x & 0xF000F000F000F000ULL) >> 12);
+}
+
+// 四行上下翻转
+uint64_t AIEvaluator::flipVertical(uint64_t x) {
+    return (x << 48) | ((x & 0xFFFF0000ULL) << 16) | ((x >> 16) & 0xFFFF0000ULL) | (x >> 48);
+}
+
+// 8种对称（翻转与转置的组合）中数值最小的一个作为规范形式
+uint64_t AIEvaluator::canonicalBoard(uint64_t x) {
+    uint64_t t = transpose(x);
+    uint64_t h = flipHorizontal(x);
+    uint64_t th = flipHorizontal(t);
+    uint64_t best = min(min(x, h), min(flipVertical(x), flipVertical(h)));
+    return min(best, min(min(t, th), min(flipVertical(t), flipVertical(th))));
+}
+
 int AIEvaluator::countEmpty(uint64_t x) {
     x |= (x >> 2) & 0x3333333333333333ULL;
     x |= (x >> 1);
@@ -195,297 +818,1930 @@ int AIEvaluator::countEmpty(uint64_t x) {
     return static_cast<int>(x & 0xf);
 }
 
-float AIEvaluator::scoreHelper(uint64_t board, const array<float, 65536>& table) {
+float AIEvaluator::scoreHelper(uint64_t board, const float* table) {
     return table[(board >> 0) & 0xFFFF] +
         table[(board >> 16) & 0xFFFF] +
         table[(board >> 32) & 0xFFFF] +
         table[(board >> 48) & 0xFFFF];
 }
 
-float AIEvaluator::scoreHeurBoard(uint64_t board) {
-    return scoreHelper(board, heurScoreTable) +
-        scoreHelper(transpose(board), heurScoreTable);
+float AIEvaluator::scoreHeurBoard(uint64_t board) {
+    return scoreHelper(board, heurScoreTable.data()) +
+        scoreHelper(transpose(board), heurScoreTable.data());
+}
+
+// ==================== 编译期预计算表 ====================
+
+constexpr uint16_t AIEvaluator::reverseRow(uint16_t row) {
+    return static_cast<uint16_t>((row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12));
+}
+
+constexpr uint64_t AIEvaluator::unpackCol(uint16_t row) {
+    uint64_t tmp = row;
+    return (tmp | (tmp << 12ULL) | (tmp << 24ULL) | (tmp << 36ULL)) & 0x000F000F000F000FULL;
+}
+
+// 编译期幂运算，指数须为0.5的整数倍（整数部分连乘，半次幂用牛顿迭代开方）
+constexpr double AIEvaluator::constPow(double base, double exponent) {
+    double result = 1.0;
+    int whole = static_cast<int>(exponent);
+    for (int i = 0; i < whole; ++i) {
+        result *= base;
+    }
+    if (exponent - whole > 0 && base > 0) {
+        double root = base > 1.0 ? base : 1.0;
+        while (true) {
+            double next = 0.5 * (root + base / root);
+            if (next >= root) break;
+            root = next;
+        }
+        result *= root;
+    }
+    return result;
+}
+
+// 把一行方块向左合并（各边长的棋盘共用）
+template <int Cells, unsigned MaxRank>
+constexpr void AIEvaluator::mergeLineLeft(unsigned* line) {
+    for (int i = 0; i < Cells - 1; ++i) {
+        int j = i + 1;
+        while (j < Cells && line[j] == 0) j++;
+        if (j == Cells) break;
+
+        if (line[i] == 0) {
+            line[i] = line[j];
+            line[j] = 0;
+            i--;
+        }
+        else if (line[i] == line[j]) {
+            if (line[i] != MaxRank) {
+                line[i]++;
+            }
+            line[j] = 0;
+        }
+    }
+}
+
+// 执行左移操作，返回移动后的行
+constexpr uint16_t AIEvaluator::moveRowLeft(uint16_t row) {
+    unsigned line[4] = {
+        (row >> 0) & 0xfu,
+        (row >> 4) & 0xfu,
+        (row >> 8) & 0xfu,
+        (row >> 12) & 0xfu
+    };
+    mergeLineLeft<4>(line);
+    return static_cast<uint16_t>((line[0] << 0) | (line[1] << 4) | (line[2] << 8) | (line[3] << 12));
+}
+
+// 实际得分
+constexpr float AIEvaluator::rowScore(uint16_t row) {
+    float score = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        int rank = (row >> (4 * i)) & 0xf;
+        if (rank >= 2) {
+            score += (rank - 1) * (1 << rank);
+        }
+    }
+    return score;
+}
+
+// 幂函数由调用方提供：编译期用constPow，运行时的非半整数指数用pow
+template <typename PowFunc>
+constexpr AIEvaluator::HeurPowers AIEvaluator::heurPowers(const HeuristicWeights& weights, PowFunc power) {
+    HeurPowers powers{};
+    for (int rank = 0; rank < HeurPowers::RANKS; ++rank) {
+        powers.sum[rank] = power(rank, weights.sumPower);
+        powers.monotonicity[rank] = power(rank, weights.monotonicityPower);
+    }
+    return powers;
+}
+
+// 启发式得分
+constexpr float AIEvaluator::heurRowScore(uint16_t row, const HeuristicWeights& weights, const HeurPowers& powers) {
+    int line[4] = {
+        (row >> 0) & 0xf,
+        (row >> 4) & 0xf,
+        (row >> 8) & 0xf,
+        (row >> 12) & 0xf
+    };
+    return heurLineScore<4>(line, weights, powers);
+}
+
+// 一行（或一列）的启发式得分，各边长的棋盘共用
+template <int Cells>
+constexpr float AIEvaluator::heurLineScore(const int* line, const HeuristicWeights& weights, const HeurPowers& powers) {
+    float sum = 0;
+    int empty = 0;
+    int merges = 0;
+
+    int prev = 0;
+    int counter = 0;
+    for (int i = 0; i < Cells; ++i) {
+        int rank = line[i];
+        sum += powers.sum[rank];
+        if (rank == 0) {
+            empty++;
+        }
+        else {
+            if (prev == rank) {
+                counter++;
+            }
+            else if (counter > 0) {
+                merges += 1 + counter;
+                counter = 0;
+            }
+            prev = rank;
+        }
+    }
+    if (counter > 0) {
+        merges += 1 + counter;
+    }
+
+    float monotonicity_left = 0;
+    float monotonicity_right = 0;
+    for (int i = 1; i < Cells; ++i) {
+        if (line[i - 1] > line[i]) {
+            monotonicity_left += powers.monotonicity[line[i - 1]] - powers.monotonicity[line[i]];
+        }
+        else {
+            monotonicity_right += powers.monotonicity[line[i]] - powers.monotonicity[line[i - 1]];
+        }
+    }
+
+    return weights.lostPenalty +
+        weights.emptyWeight * empty +
+        weights.mergesWeight * merges -
+        weights.monotonicityWeight * (monotonicity_left < monotonicity_right ? monotonicity_left : monotonicity_right) -
+        weights.sumWeight * sum;
+}
+
+template <typename T, size_t Count, typename RowFunc>
+constexpr array<T, Count> AIEvaluator::buildTable(RowFunc rowFunc, unsigned firstRow) {
+    array<T, Count> table{};
+    for (unsigned row = 0; row < Count; ++row) {
+        table[row] = rowFunc(static_cast<uint16_t>(firstRow + row));
+    }
+    return table;
+}
+
+// 右移和下移表由左移结果镜像得到，表项存放与原行的异或差值
+// 左右移共用一张表，同一行的两个结果在一次访存中取得
+constexpr array<uint32_t, 65536> AIEvaluator::rowMoveTable = buildTable<uint32_t>([](uint16_t row) {
+    return static_cast<uint32_t>(row ^ moveRowLeft(row)) |
+        (static_cast<uint32_t>(row ^ reverseRow(moveRowLeft(reverseRow(row)))) << 16);
+});
+
+constexpr array<uint64_t, 65536> AIEvaluator::colUpTable = buildTable<uint64_t>([](uint16_t row) {
+    return unpackCol(row) ^ unpackCol(moveRowLeft(row));
+});
+
+constexpr array<uint64_t, 65536> AIEvaluator::colDownTable = buildTable<uint64_t>([](uint16_t row) {
+    return unpackCol(row) ^ unpackCol(reverseRow(moveRowLeft(reverseRow(row))));
+});
+
+constexpr AIEvaluator::HeurPowers AIEvaluator::DEFAULT_POWERS = heurPowers(DEFAULT_WEIGHTS, constPow);
+
+// 启发式逐行计算量较大，两半各自作为一次常量求值，避免超过编译器默认的求值步数限制
+constexpr array<float, 65536> AIEvaluator::heurScoreTable = []() {
+    constexpr auto rowFunc = [](uint16_t row) { return heurRowScore(row, DEFAULT_WEIGHTS, DEFAULT_POWERS); };
+    constexpr array<float, 32768> low = buildTable<float, 32768>(rowFunc, 0);
+    constexpr array<float, 32768> high = buildTable<float, 32768>(rowFunc, 32768);
+    array<float, 65536> table{};
+    for (unsigned row = 0; row < 32768; ++row) {
+        table[row] = low[row];
+        table[row + 32768] = high[row];
+    }
+    return table;
+}();
+
+constexpr array<float, 65536> AIEvaluator::scoreTable = buildTable<float>(rowScore);
+
+// 叶子估值是8个表项之和，机会节点取平均、移动节点取最大（无路可走为0），都不会超过这个上界
+constexpr float AIEvaluator::HEUR_UPPER_BOUND = []() {
+    float best = 0.0f;
+    for (float value : heurScoreTable) {
+        if (value > best) best = value;
+    }
+    return best * 8;
+}();
+
+// 执行移动
+uint64_t AIEvaluator::executeMove(int move, uint64_t board) {
+    switch (move) {
+    case 0: { // up
+        uint64_t ret = board;
+        uint64_t t = transpose(board);
+        ret ^= colUpTable[(t >> 0) & 0xFFFF] << 0;
+        ret ^= colUpTable[(t >> 16) & 0xFFFF] << 4;
+        ret ^= colUpTable[(t >> 32) & 0xFFFF] << 8;
+        ret ^= colUpTable[(t >> 48) & 0xFFFF] << 12;
+        return ret;
+    }
+    case 1: { // down
+        uint64_t ret = board;
+        uint64_t t = transpose(board);
+        ret ^= colDownTable[(t >> 0) & 0xFFFF] << 0;
+        ret ^= colDownTable[(t >> 16) & 0xFFFF] << 4;
+        ret ^= colDownTable[(t >> 32) & 0xFFFF] << 8;
+        ret ^= colDownTable[(t >> 48) & 0xFFFF] << 12;
+        return ret;
+    }
+    case 2: { // left
+        uint64_t ret = board;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 0) & 0xFFFF] & 0xFFFF) << 0;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 16) & 0xFFFF] & 0xFFFF) << 16;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 32) & 0xFFFF] & 0xFFFF) << 32;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 48) & 0xFFFF] & 0xFFFF) << 48;
+        return ret;
+    }
+    case 3: { // right
+        uint64_t ret = board;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 0) & 0xFFFF] >> 16) << 0;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 16) & 0xFFFF] >> 16) << 16;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 32) & 0xFFFF] >> 16) << 32;
+        ret ^= static_cast<uint64_t>(rowMoveTable[(board >> 48) & 0xFFFF] >> 16) << 48;
+        return ret;
+    }
+    default:
+        return ~0ULL;
+    }
+}
+
+// ==================== 四方向移动内核 ====================
+
+void AIEvaluator::executeAllMovesScalar(uint64_t board, uint64_t* out) {
+    uint64_t t = transpose(board);
+    uint64_t up = board, down = board, left = board, right = board;
+    for (int i = 0; i < 4; i++) {
+        uint16_t col = static_cast<uint16_t>(t >> (16 * i));
+        uint32_t lr = rowMoveTable[static_cast<uint16_t>(board >> (16 * i))];
+        up ^= colUpTable[col] << (4 * i);
+        down ^= colDownTable[col] << (4 * i);
+        left ^= static_cast<uint64_t>(lr & 0xFFFF) << (16 * i);
+        right ^= static_cast<uint64_t>(lr >> 16) << (16 * i);
+    }
+    out[0] = up;
+    out[1] = down;
+    out[2] = left;
+    out[3] = right;
+}
+
+#ifdef AI_X86_SIMD
+// 四列的上移/下移差值和四行的左右移差值各用一条gather取出，移位后在寄存器内异或归并
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+void AIEvaluator::executeAllMovesAvx2(uint64_t board, uint64_t* out) {
+    uint64_t t = transpose(board);
+    __m128i rows = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&board)));
+    __m128i cols = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&t)));
+
+    const long long* upBase = reinterpret_cast<const long long*>(colUpTable.data());
+    const long long* downBase = reinterpret_cast<const long long*>(colDownTable.data());
+    __m256i colShift = _mm256_setr_epi64x(0, 4, 8, 12);
+    __m256i up = _mm256_sllv_epi64(_mm256_i32gather_epi64(upBase, cols, 8), colShift);
+    __m256i down = _mm256_sllv_epi64(_mm256_i32gather_epi64(downBase, cols, 8), colShift);
+
+    // 把四个表项的低16位（左移）和高16位（右移）分别收拢到低、高64位
+    __m128i lr = _mm_i32gather_epi32(reinterpret_cast<const int*>(rowMoveTable.data()), rows, 4);
+    lr = _mm_shuffle_epi8(lr, _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15));
+    __m256i rowShift = _mm256_setr_epi64x(0, 16, 32, 48);
+    __m256i left = _mm256_sllv_epi64(_mm256_cvtepu16_epi64(lr), rowShift);
+    __m256i right = _mm256_sllv_epi64(_mm256_cvtepu16_epi64(_mm_srli_si128(lr, 8)), rowShift);
+
+    // 四个向量各自的四个通道异或归并为一个通道，顺序为上、下、左、右
+    __m256i ud = _mm256_xor_si256(_mm256_unpacklo_epi64(up, down), _mm256_unpackhi_epi64(up, down));
+    __m256i lrv = _mm256_xor_si256(_mm256_unpacklo_epi64(left, right), _mm256_unpackhi_epi64(left, right));
+    __m256i deltas = _mm256_xor_si256(_mm256_permute2x128_si256(ud, lrv, 0x20),
+        _mm256_permute2x128_si256(ud, lrv, 0x31));
+    __m256i result = _mm256_xor_si256(deltas, _mm256_set1_epi64x(static_cast<long long>(board)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+}
+
+// 把四个64位通道各自转置，与transpose相同的位运算
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+static inline __m256i transposeLanesAvx2(__m256i x) {
+    __m256i a1 = _mm256_and_si256(x, _mm256_set1_epi64x(static_cast<long long>(0xF0F00F0FF0F00F0FULL)));
+    __m256i a2 = _mm256_and_si256(x, _mm256_set1_epi64x(static_cast<long long>(0x0000F0F00000F0F0ULL)));
+    __m256i a3 = _mm256_and_si256(x, _mm256_set1_epi64x(static_cast<long long>(0x0F0F00000F0F0000ULL)));
+    __m256i a = _mm256_or_si256(a1, _mm256_or_si256(_mm256_slli_epi64(a2, 12), _mm256_srli_epi64(a3, 12)));
+    __m256i b1 = _mm256_and_si256(a, _mm256_set1_epi64x(static_cast<long long>(0xFF00FF0000FF00FFULL)));
+    __m256i b2 = _mm256_and_si256(a, _mm256_set1_epi64x(static_cast<long long>(0x00FF00FF00000000ULL)));
+    __m256i b3 = _mm256_and_si256(a, _mm256_set1_epi64x(static_cast<long long>(0x00000000FF00FF00ULL)));
+    return _mm256_or_si256(b1, _mm256_or_si256(_mm256_srli_epi64(b2, 24), _mm256_slli_epi64(b3, 24)));
+}
+
+// 第k轮gather取出四个棋盘的第k行和四个转置棋盘的第k行，逐轮累加，
+// 加法顺序与scoreHelper相同，因此结果逐位一致
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+void AIEvaluator::scoreHeurBoardsAvx2(const uint64_t* boards, float* out, const float* table) {
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(boards));
+    __m256i t = transposeLanesAvx2(b);
+    __m256i rowMask = _mm256_set1_epi64x(0xFFFF);
+    __m256i lowHalves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+    __m256 sum = _mm256_setzero_ps();
+    for (int k = 0; k < 4; k++) {
+        __m128i shift = _mm_cvtsi32_si128(16 * k);
+        __m256i rows = _mm256_permutevar8x32_epi32(_mm256_and_si256(_mm256_srl_epi64(b, shift), rowMask), lowHalves);
+        __m256i cols = _mm256_permutevar8x32_epi32(_mm256_and_si256(_mm256_srl_epi64(t, shift), rowMask), lowHalves);
+        __m256i idx = _mm256_blend_epi32(rows, cols, 0xF0);
+        __m256 g = _mm256_i32gather_ps(table, idx, 4);
+        sum = k == 0 ? g : _mm256_add_ps(sum, g);
+    }
+    _mm_storeu_ps(out, _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+}
+#endif
+
+// 先算出全部转置再查表，四组相互独立的访存可以重叠
+void AIEvaluator::scoreHeurBoardsScalar(const uint64_t* boards, float* out, const float* table) {
+    uint64_t t[4];
+    for (int i = 0; i < 4; i++) t[i] = transpose(boards[i]);
+    for (int i = 0; i < 4; i++) {
+        out[i] = scoreHelper(boards[i], table) + scoreHelper(t[i], table);
+    }
+}
+
+bool AIEvaluator::cpuSupportsAvx2() {
+#if !defined(AI_X86_SIMD)
+    return false;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// 默认使用标量内核，main解析参数后再按CPU特性切换
+AIEvaluator::AllMovesKernel AIEvaluator::allMovesKernel = AIEvaluator::executeAllMovesScalar;
+AIEvaluator::LeafKernel AIEvaluator::leafKernel = AIEvaluator::scoreHeurBoardsScalar;
+
+const char* AIEvaluator::selectSimdKernels(bool useSimd) {
+#ifdef AI_X86_SIMD
+    if (useSimd && cpuSupportsAvx2()) {
+        allMovesKernel = executeAllMovesAvx2;
+        leafKernel = scoreHeurBoardsAvx2;
+        return "avx2";
+    }
+#endif
+    allMovesKernel = executeAllMovesScalar;
+    leafKernel = scoreHeurBoardsScalar;
+    return "scalar";
+}
+
+// 汇总单个搜索任务的统计
+void AIEvaluator::flushStats(const EvalState& state) {
+    statNodes += state.moves_evaled - state.moves_flushed;
+    statCacheprobes += state.cacheprobes;
+    statCachehits += state.cachehits;
+    int depth = statMaxdepth.load();
+    while (state.maxdepth > depth && !statMaxdepth.compare_exchange_weak(depth, state.maxdepth)) {}
+    if (state.depthLimited) statDepthLimited = true;
+}
+
+// 定期检查取消标记和预算，节点计数同时汇总到全局以便多线程共享节点预算
+bool AIEvaluator::checkAbort(EvalState& state) {
+    if (aborted.load(memory_order_relaxed)) return true;
+    if (state.moves_evaled - state.moves_flushed < ABORT_CHECK_INTERVAL) return false;
+
+    unsigned long long nodes = (statNodes += state.moves_evaled - state.moves_flushed);
+    state.moves_flushed = state.moves_evaled;
+
+    bool stop = cancelFlag && cancelFlag->load(memory_order_relaxed);
+    if (limitsActive) {
+        if (AI_OPTIONS.moveNodes > 0 && nodes >= AI_OPTIONS.moveNodes) stop = true;
+        if (AI_OPTIONS.moveTimeMs > 0 && chrono::steady_clock::now() >= deadline) stop = true;
+    }
+    if (stop) aborted = true;
+    return stop;
+}
+
+// 递归评估函数
+// alpha为父节点已知的最佳值：本节点估值上界不超过alpha时提前返回这个上界（Star1剪枝），
+// 父节点取最大值时会忽略它，因此返回给上层的值不受影响。剪枝的结果作为上界写入置换表，
+// 之后只在同样能剪掉的场合复用
+template <class Leaf>
+float AIEvaluator::scoreTileChooseNode(EvalState& state, const Leaf& leaf, uint64_t board, float cprob, float alpha) {
+    if (cprob < CPROB_THRESH_BASE || state.curdepth >= state.depth_limit) {
+        state.maxdepth = max(state.curdepth, state.maxdepth);
+        if (state.curdepth >= state.depth_limit) state.depthLimited = true;
+        return leaf.score(board);
+    }
+
+    // 置换表按剩余深度记录，剩余深度不小于当前需求的条目才可复用
+    // 启发式对行和列使用同一张对称的表（n-tuple网络对8种对称求和），对称局面的估值相同，可共用规范形式下的条目
+    int remaining = state.depth_limit - state.curdepth;
+    bool prunable = Leaf::HAS_BOUND && AI_OPTIONS.prune && alpha > 0.0f;
+    float upperBound = leaf.upperBound();
+    float alphaCutoff = alpha - PRUNE_MARGIN * upperBound;
+    uint64_t ttKey = board;
+    if (state.curdepth < CACHE_DEPTH_LIMIT) {
+        if (AI_OPTIONS.ttSymmetry) ttKey = canonicalBoard(board);
+        float cached;
+        bool cachedBound;
+        state.cacheprobes++;
+        if (state.transTable.probe(ttKey, remaining, cached, cachedBound) &&
+            (!cachedBound || (prunable && cached <= alphaCutoff))) {
+            state.cachehits++;
+            state.depthLimited = true;
+            return cached;
+        }
+    }
+
+    int num_open = countEmpty(board);
+    if (num_open == 0) return 0.0f;
+    bool approximate = cprob < AI_OPTIONS.approxMass;
+    cprob /= num_open;
+
+    float res = 0.0f;
+    if (approximate) {
+        res = scoreSpawnsSampled(state, leaf, board, cprob, num_open);
+    }
+    else if (pool && state.curdepth < PARALLEL_SPLIT_DEPTH &&
+        state.depth_limit - state.curdepth >= PARALLEL_MIN_REMAINING) {
+        res = scoreSpawnsParallel(state, leaf, board, cprob, num_open);
+    }
+    else {
+        uint64_t tmp = board;
+        uint64_t tile_2 = 1;
+        int count = 0;
+        float cutoff = alphaCutoff * num_open;
+
+        while (tile_2 && count < num_open) {
+            if ((tmp & 0xf) == 0) {
+                // 90%概率生成2，10%概率生成4
+                res += scoreMoveNode(state, leaf, board | tile_2, cprob * 0.9f) * 0.9f;
+                res += scoreMoveNode(state, leaf, board | (tile_2 << 1), cprob * 0.1f) * 0.1f;
+                count++;
+
+                // 未展开的格子按上界计算，仍不能超过alpha时剩余分支不必再搜
+                float bound = res + (num_open - count) * upperBound;
+                if (prunable && count < num_open && bound <= cutoff) {
+                    // 中止时子节点返回的0不是下界，算出的上界无效
+                    if (state.curdepth < CACHE_DEPTH_LIMIT && !aborted.load(memory_order_relaxed)) {
+                        state.transTable.store(ttKey, remaining, bound / num_open, true);
+                    }
+                    return bound / num_open;
+                }
+            }
+            tmp >>= 4;
+            tile_2 <<= 4;
+        }
+    }
+
+    // 中止后的结果不完整，不能写入置换表
+    if (aborted.load(memory_order_relaxed)) return 0.0f;
+
+    res = res / num_open;
+
+    if (state.curdepth < CACHE_DEPTH_LIMIT) {
+        state.transTable.store(ttKey, remaining, res);
+    }
+
+    return res;
+}
+
+// 近似展开低概率机会节点：忽略出4，只在部分空格上出2并取平均，
+// 采样位置由局面哈希决定，同一局面每次得到相同结果。返回值与精确展开一样尚未除以num_open
+template <class Leaf>
+float AIEvaluator::scoreSpawnsSampled(EvalState& state, const Leaf& leaf, uint64_t board, float cprob, int num_open) {
+    int cells[16];
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+        if (((board >> (4 * i)) & 0xf) == 0) cells[count++] = i;
+    }
+
+    int samples = min(num_open, max(1, AI_OPTIONS.approxCells));
+    int offset = static_cast<int>(((board * 0x9E3779B97F4A7C15ULL) >> 32) % num_open);
+    float res = 0.0f;
+    for (int j = 0; j < samples; j++) {
+        int cell = cells[(offset + j * num_open / samples) % num_open];
+        res += scoreMoveNode(state, leaf, board | (1ULL << (4 * cell)), cprob * 0.9f);
+    }
+    return res * num_open / samples;
+}
+
+// 并行展开机会节点：每种生成结果作为一个任务，按串行顺序累加保证结果一致
+template <class Leaf>
+float AIEvaluator::scoreSpawnsParallel(EvalState& state, const Leaf& leaf, uint64_t board, float cprob, int num_open) {
+    float childScores[32];
+    int curdepth = state.curdepth;
+    int depth_limit = state.depth_limit;
+
+    {
+        TaskGroup group(*pool);
+        uint64_t tmp = board;
+        uint64_t tile_2 = 1;
+        int count = 0;
+
+        while (tile_2 && count < num_open) {
+            if ((tmp & 0xf) == 0) {
+                for (int k = 0; k < 2; k++) {
+                    uint64_t child = board | (tile_2 << k);
+                    float childProb = cprob * (k == 0 ? 0.9f : 0.1f);
+                    float* slot = &childScores[count * 2 + k];
+                    group.run([this, &leaf, child, childProb, slot, curdepth, depth_limit]() {
+                        EvalState sub(*transTable);
+                        sub.curdepth = curdepth;
+                        sub.depth_limit = depth_limit;
+                        *slot = scoreMoveNode(sub, leaf, child, childProb);
+                        flushStats(sub);
+                    });
+                }
+                count++;
+            }
+            tmp >>= 4;
+            tile_2 <<= 4;
+        }
+        group.wait();
+    }
+
+    float res = 0.0f;
+    for (int i = 0; i < num_open; i++) {
+        res += childScores[i * 2] * 0.9f;
+        res += childScores[i * 2 + 1] * 0.1f;
+    }
+    return res;
+}
+
+// 带收益的评估器：移动节点的值为本步合并得分加上后继局面的估值，子节点的alpha相应扣除本步得分
+template <class Leaf>
+float AIEvaluator::scoreMoveNode(EvalState& state, const Leaf& leaf, uint64_t board, float cprob) {
+    if (checkAbort(state)) return 0.0f;
+
+    float best = 0.0f;
+    state.curdepth++;
+
+    uint64_t newboards[4];
+    executeAllMoves(board, newboards);
+
+    // 叶子条件只取决于概率和深度，四个后继要么全是叶子要么都不是：全是叶子时批量评估
+    if (AI_OPTIONS.leafBatch && (cprob < CPROB_THRESH_BASE || state.curdepth >= state.depth_limit)) {
+        float leafScores[4];
+        leaf.scoreBatch(newboards, leafScores);
+
+        bool anyMove = false;
+        for (int move = 0; move < 4; ++move) {
+            state.moves_evaled++;
+            if (board != newboards[move]) {
+                anyMove = true;
+                float reward = Leaf::HAS_REWARDS ? moveReward(board, newboards[move]) : 0.0f;
+                best = max(best, reward + leafScores[move]);
+            }
+        }
+        if (anyMove) {
+            state.maxdepth = max(state.curdepth, state.maxdepth);
+            if (state.curdepth >= state.depth_limit) state.depthLimited = true;
+        }
+
+        state.curdepth--;
+        return best;
+    }
+
+    // 子节点会串行展开、可能被剪枝时，先搜索静态估值最高的方向，尽早得到较高的alpha。
+    // 子节点是叶子、并行展开或近似展开时alpha用不上，不必花一次批量评估来排序
+    int order[4] = { 0, 1, 2, 3 };
+    bool childrenPrunable = cprob >= CPROB_THRESH_BASE && state.curdepth < state.depth_limit &&
+        cprob >= AI_OPTIONS.approxMass &&
+        !(pool && state.curdepth < PARALLEL_SPLIT_DEPTH && state.depth_limit - state.curdepth >= PARALLEL_MIN_REMAINING);
+    if (Leaf::HAS_BOUND && AI_OPTIONS.prune && childrenPrunable) {
+        float staticScores[4];
+        leaf.scoreBatch(newboards, staticScores);
+        for (int move = 0; move < 4; ++move) {
+            if (board == newboards[move]) staticScores[move] = -numeric_limits<float>::infinity();
+        }
+        sort(order, order + 4, [&staticScores](int a, int b) { return staticScores[a] > staticScores[b]; });
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        uint64_t newboard = newboards[order[i]];
+        state.moves_evaled++;
+
+        if (board != newboard) {
+            float reward = Leaf::HAS_REWARDS ? moveReward(board, newboard) : 0.0f;
+            best = max(best, reward + scoreTileChooseNode(state, leaf, newboard, cprob, best - reward));
+        }
+    }
+
+    state.curdepth--;
+    return best;
+}
+
+template <class Leaf>
+float AIEvaluator::scoreTopLevelMove(const Leaf& leaf, uint64_t board, int move, int depth) {
+    uint64_t newboard = executeMove(move, board);
+
+    if (board == newboard) return 0.0f;
+
+    EvalState state(*transTable);
+    state.depth_limit = depth;
+
+    // 根节点各方向的得分都要显示，不做剪枝
+    float reward = Leaf::HAS_REWARDS ? moveReward(board, newboard) : 0.0f;
+    float res = reward + scoreTileChooseNode(state, leaf, newboard, 1.0f, -numeric_limits<float>::infinity()) + 1e-6;
+    flushStats(state);
+    return res;
+}
+
+// 表中最大项的8倍，与HEUR_UPPER_BOUND的计算方式相同
+float AIEvaluator::upperBoundOf(const float* table) {
+    float best = 0.0f;
+    for (int i = 0; i < 65536; i++) {
+        if (table[i] > best) best = table[i];
+    }
+    return best * 8;
+}
+
+// 半整数指数仍用constPow，与编译期的表保持一致
+AIEvaluator::HeurPowers AIEvaluator::runtimeHeurPowers(const HeuristicWeights& weights) {
+    auto power = [](double base, double exponent) {
+        return exponent >= 0 && exponent * 2 == floor(exponent * 2) ? constPow(base, exponent) : pow(base, exponent);
+    };
+    return heurPowers(weights, power);
+}
+
+void AIEvaluator::buildHeuristicTable(const HeuristicWeights& weights) {
+    heurWeights = weights;
+    if (weights == DEFAULT_WEIGHTS) {
+        heurTableStorage.reset();
+        heurTable = heurScoreTable.data();
+        heurUpperBound = HEUR_UPPER_BOUND;
+    }
+    else {
+        HeurPowers powers = runtimeHeurPowers(weights);
+        auto table = make_shared<vector<float>>(65536);
+        for (unsigned row = 0; row < 65536; ++row) {
+            (*table)[row] = heurRowScore(static_cast<uint16_t>(row), weights, powers);
+        }
+        heurTableStorage = table;
+        heurTable = table->data();
+        heurUpperBound = upperBoundOf(heurTable);
+    }
+}
+
+void AIEvaluator::setHeuristicWeights(const HeuristicWeights& weights) {
+    buildHeuristicTable(weights);
+    transTable->clear();
+}
+
+void AIEvaluator::setNetwork(shared_ptr<const NTupleNetwork> net) {
+    network = move(net);
+    transTable->clear();
+}
+
+// 快照校验参数：启发式权重、网络权重或搜索参数变化后旧快照不可再用
+vector<float> AIEvaluator::snapshotParams() const {
+    return {
+        heurWeights.lostPenalty,
+        heurWeights.monotonicityPower,
+        heurWeights.monotonicityWeight,
+        heurWeights.sumPower,
+        heurWeights.sumWeight,
+        heurWeights.mergesWeight,
+        heurWeights.emptyWeight,
+        CPROB_THRESH_BASE,
+        static_cast<float>(CACHE_DEPTH_LIMIT),
+        AI_OPTIONS.approxMass,
+        static_cast<float>(AI_OPTIONS.approxCells),
+        static_cast<float>(network ? network->checksum() & 0xffffff : 0)   // float只能精确表示24位
+    };
+}
+
+bool AIEvaluator::loadTableSnapshot(const string& path) {
+    return transTable->loadSnapshot(path, snapshotParams());
+}
+
+bool AIEvaluator::saveTableSnapshot(const string& path) {
+    return transTable->saveSnapshot(path, snapshotParams());
+}
+
+// 棋盘表示转换函数
+uint64_t AIEvaluator::convertToBitboard(const vector<vector<int>>& board) {
+    uint64_t bitboard = 0;
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            int value = board[i][j];
+            int tile = 0;
+
+            while (tile < 15 && (value >> (tile + 1)) > 0) tile++;
+
+            int shift = (i * 4 + j) * 4;
+            bitboard |= static_cast<uint64_t>(tile) << shift;
+        }
+    }
+
+    return bitboard;
+}
+
+// 评估四个方向的得分
+vector<float> AIEvaluator::evaluateAllMoves(const vector<vector<int>>& board, const atomic<bool>* cancel) {
+    return evaluateAllMoves(convertToBitboard(board), cancel);
+}
+
+// 按给定深度搜索四个方向
+template <class Leaf>
+vector<float> AIEvaluator::searchRoot(const Leaf& leaf, uint64_t bitboard, int depth) {
+    vector<float> scores(4, 0.0f);
+
+    if (pool) {
+        TaskGroup group(*pool);
+        for (int move = 0; move < 4; move++) {
+            group.run([this, &leaf, &scores, bitboard, move, depth]() {
+                scores[move] = scoreTopLevelMove(leaf, bitboard, move, depth);
+            });
+        }
+        group.wait();
+    }
+    else {
+        for (int move = 0; move < 4; move++) {
+            scores[move] = scoreTopLevelMove(leaf, bitboard, move, depth);
+        }
+    }
+
+    return scores;
+}
+
+vector<float> AIEvaluator::evaluateAllMoves(uint64_t bitboard, const atomic<bool>* cancel) {
+    auto start = chrono::steady_clock::now();
+
+    transTable->newSearch();
+    statNodes = 0;
+    statCacheprobes = 0;
+    statCachehits = 0;
+    statMaxdepth = 0;
+    aborted = false;
+    cancelFlag = cancel;
+    deadline = start + chrono::milliseconds(AI_OPTIONS.moveTimeMs);
+
+    // 没有预算时保持原来的固定深度；有预算时从深度1开始迭代加深
+    int fixedDepth = AI_OPTIONS.searchDepth > 0 ? AI_OPTIONS.searchDepth :
+        network ? NTUPLE_SEARCH_DEPTH : max(3, countDistinctTiles(bitboard) - 2);
+    bool budgeted = AI_OPTIONS.moveTimeMs > 0 || AI_OPTIONS.moveNodes > 0;
+    int firstDepth = budgeted ? 1 : fixedDepth;
+    int lastDepth = budgeted && AI_OPTIONS.searchDepth <= 0 ? MAX_SEARCH_DEPTH : fixedDepth;
+
+    vector<float> scores(4, 0.0f);
+    lastStats.completedDepth = 0;
+
+    for (int depth = firstDepth; depth <= lastDepth; depth++) {
+        limitsActive = depth > firstDepth;
+        statDepthLimited = false;
+        vector<float> depthScores = network ? searchRoot(NTupleLeaf(*network), bitboard, depth) :
+            searchRoot(HeuristicLeaf(heurTable, heurUpperBound), bitboard, depth);
+        if (aborted) break;
+
+        scores = depthScores;
+        lastStats.completedDepth = depth;
+
+        // 所有分支都已被概率阈值截断，继续加深不会改变结果
+        if (!statDepthLimited) break;
+    }
+
+    lastStats.nodes = statNodes;
+    lastStats.cacheprobes = statCacheprobes;
+    lastStats.cachehits = statCachehits;
+    lastStats.maxdepth = statMaxdepth;
+    lastStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    lastStats.ttEntries = transTable->capacity();
+    lastStats.ttFill = transTable->sampleOccupancy();
+
+    return scores;
+}
+
+// 获取最佳移动建议
+pair<int, vector<float>> AIEvaluator::getBestMove(const vector<vector<int>>& board, const atomic<bool>* cancel) {
+    return getBestMove(convertToBitboard(board), cancel);
+}
+
+pair<int, vector<float>> AIEvaluator::getBestMove(uint64_t bitboard, const atomic<bool>* cancel) {
+    vector<float> scores = evaluateAllMoves(bitboard, cancel);
+
+    int bestMove = -1;
+    float bestScore = -1.0f;
+
+    for (int i = 0; i < 4; i++) {
+        if (scores[i] > bestScore) {
+            bestScore = scores[i];
+            bestMove = i;
+        }
+    }
+
+    return { bestMove, scores };
+}
+
+string searchStatsJson(const vector<vector<int>>& board, const SearchStats& stats, int bestMove, bool pondered) {
+    long long timestamp = chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    int empty = 0;
+    int maxTile = 0;
+    uint64_t ranks = 0;
+    for (const auto& row : board) {
+        for (int value : row) {
+            int rank = 0;
+            while ((value >> rank) > 1) rank++;
+            if (value == 0) empty++;
+            else ranks |= 1ULL << rank;
+            maxTile = max(maxTile, value);
+        }
+    }
+    int distinct = 0;
+    for (; ranks; ranks &= ranks - 1) distinct++;
+
+    ostringstream out;
+    out << "{\"time_ms\":" << timestamp;
+    // 4x4的普通局面记为16位十六进制的位棋盘，其他尺寸和宽方块的局面记为按行排列的数值
+    if (board.size() == 4 && !needsWideBoard(board)) {
+        out << ",\"board\":\"" << hex << setw(16) << setfill('0') << AIEvaluator::convertToBitboard(board)
+            << dec << setfill(' ') << "\"";
+    }
+    else {
+        out << ",\"board\":[";
+        for (size_t i = 0; i < board.size(); i++) {
+            out << (i ? ",[" : "[");
+            for (size_t j = 0; j < board[i].size(); j++) out << (j ? "," : "") << board[i][j];
+            out << "]";
+        }
+        out << "]";
+    }
+    out << ",\"empty\":" << empty
+        << ",\"distinct\":" << distinct
+        << ",\"max_tile\":" << maxTile
+        << ",\"best_move\":" << bestMove
+        << ",\"pondered\":" << (pondered ? "true" : "false")
+        << ",\"book\":" << (stats.book ? "true" : "false")
+        << ",\"nodes\":" << stats.nodes
+        << ",\"nodes_per_sec\":" << fixed << setprecision(0) << stats.nodesPerSecond()
+        << ",\"tt_probes\":" << stats.cacheprobes
+        << ",\"tt_hit_rate\":" << setprecision(4) << stats.cacheHitRate()
+        << ",\"max_depth\":" << stats.maxdepth
+        << ",\"completed_depth\":" << stats.completedDepth
+        << ",\"seconds\":" << setprecision(6) << stats.seconds
+        << ",\"tt_entries\":" << stats.ttEntries
+        << ",\"tt_fill\":" << setprecision(4) << stats.ttFill
+        << "}";
+    return out.str();
+}
+
+// ==================== BoardEngine实现 ====================
+
+template <int N, int BITS>
+uint32_t BoardEngine<N, BITS>::reverseRow(uint32_t row) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < N; i++) reversed |= ((row >> (BITS * i)) & CELL_MASK) << (BITS * (N - 1 - i));
+    return reversed;
+}
+
+template <int N, int BITS>
+uint32_t BoardEngine<N, BITS>::moveRowLeft(uint32_t row) {
+    unsigned line[N];
+    for (int i = 0; i < N; i++) line[i] = (row >> (BITS * i)) & CELL_MASK;
+    AIEvaluator::mergeLineLeft<N, CELL_MASK>(line);
+
+    uint32_t result = 0;
+    for (int i = 0; i < N; i++) result |= line[i] << (BITS * i);
+    return result;
+}
+
+// 启发式权重取AI_OPTIONS.weights，在首次使用时固定
+template <int N, int BITS>
+const AIEvaluator::HeurPowers& BoardEngine<N, BITS>::heurPowers() {
+    static const AIEvaluator::HeurPowers powers = AIEvaluator::runtimeHeurPowers(AI_OPTIONS.weights);
+    return powers;
+}
+
+template <int N, int BITS>
+float BoardEngine<N, BITS>::heurRowScore(uint32_t row) {
+    int line[N];
+    for (int i = 0; i < N; i++) line[i] = (row >> (BITS * i)) & CELL_MASK;
+    return AIEvaluator::heurLineScore<N>(line, AI_OPTIONS.weights, heurPowers());
+}
+
+// 与AIEvaluator::rowScore相同：每个方块计入合成它累计得到的分数
+template <int N, int BITS>
+double BoardEngine<N, BITS>::tileRowScore(uint32_t row) {
+    double score = 0.0;
+    for (int i = 0; i < N; i++) {
+        int rank = (row >> (BITS * i)) & CELL_MASK;
+        if (rank >= 2) score += (rank - 1) * static_cast<double>(1u << rank);
+    }
+    return score;
+}
+
+template <int N, int BITS>
+const typename BoardEngine<N, BITS>::RowTables& BoardEngine<N, BITS>::rowTables() {
+    static const RowTables tables = []() {
+        RowTables t;
+        const uint32_t count = ROW_TABLES ? 1u << (BITS * N) : 0;
+        t.left.resize(count);
+        t.right.resize(count);
+        t.heur.resize(count);
+        t.score.resize(count);
+        for (uint32_t row = 0; row < count; row++) {
+            t.left[row] = moveRowLeft(row);
+            t.right[row] = reverseRow(moveRowLeft(reverseRow(row)));
+            t.heur[row] = heurRowScore(row);
+            t.score[row] = tileRowScore(row);
+        }
+        return t;
+    }();
+    return tables;
+}
+
+template <int N, int BITS>
+uint32_t BoardEngine<N, BITS>::rowLeft(uint32_t row) {
+    return ROW_TABLES ? rowTables().left[row] : moveRowLeft(row);
+}
+
+template <int N, int BITS>
+uint32_t BoardEngine<N, BITS>::rowRight(uint32_t row) {
+    return ROW_TABLES ? rowTables().right[row] : reverseRow(moveRowLeft(reverseRow(row)));
+}
+
+template <int N, int BITS>
+float BoardEngine<N, BITS>::rowHeur(uint32_t row) {
+    return ROW_TABLES ? rowTables().heur[row] : heurRowScore(row);
+}
+
+template <int N, int BITS>
+double BoardEngine<N, BITS>::rowScore(uint32_t row) {
+    return ROW_TABLES ? rowTables().score[row] : tileRowScore(row);
+}
+
+template <int N, int BITS>
+typename BoardEngine<N, BITS>::Board BoardEngine<N, BITS>::convertToBitboard(const vector<vector<int>>& board) {
+    Board bitboard{};
+    for (int i = 0; i < N; i++) {
+        uint32_t row = 0;
+        for (int j = 0; j < N; j++) {
+            int value = board[i][j];
+            int tile = 0;
+            while (tile < static_cast<int>(CELL_MASK) && (value >> (tile + 1)) > 0) tile++;
+            row |= static_cast<uint32_t>(tile) << (BITS * j);
+        }
+        Packing::setRow(bitboard, i, row);
+    }
+    return bitboard;
+}
+
+template <int N, int BITS>
+typename BoardEngine<N, BITS>::Board BoardEngine<N, BITS>::transpose(const Board& board) {
+    Board result{};
+    for (int col = 0; col < N; col++) {
+        uint32_t row = 0;
+        for (int i = 0; i < N; i++) row |= static_cast<uint32_t>(getCell(board, i, col)) << (BITS * i);
+        Packing::setRow(result, col, row);
+    }
+    return result;
+}
+
+// 移动编号与AIEvaluator相同：0上 1下 2左 3右；上下移动先转置成左右
+template <int N, int BITS>
+typename BoardEngine<N, BITS>::Board BoardEngine<N, BITS>::executeMove(int move, const Board& board) {
+    bool vertical = move < 2;
+    bool towardStart = move == 0 || move == 2;
+    Board source = vertical ? transpose(board) : board;
+    Board result{};
+    for (int i = 0; i < N; i++) {
+        uint32_t row = Packing::getRow(source, i);
+        Packing::setRow(result, i, towardStart ? rowLeft(row) : rowRight(row));
+    }
+    return vertical ? transpose(result) : result;
+}
+
+template <int N, int BITS>
+int BoardEngine<N, BITS>::countEmpty(const Board& board) {
+    int empty = 0;
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) empty += getCell(board, i, j) == 0;
+    }
+    return empty;
+}
+
+template <int N, int BITS>
+int BoardEngine<N, BITS>::countDistinctTiles(const Board& board) {
+    uint32_t bitset = 0;
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) bitset |= 1 << getCell(board, i, j);
+    }
+    bitset >>= 1; // 不统计空tile
+
+    int count = 0;
+    while (bitset) {
+        bitset &= bitset - 1;
+        count++;
+    }
+    return count;
+}
+
+template <int N, int BITS>
+float BoardEngine<N, BITS>::scoreHeurBoard(const Board& board) {
+    Board transposed = transpose(board);
+    float score = 0.0f;
+    for (int i = 0; i < N; i++) {
+        score += rowHeur(Packing::getRow(board, i)) + rowHeur(Packing::getRow(transposed, i));
+    }
+    return score;
+}
+
+template <int N, int BITS>
+double BoardEngine<N, BITS>::moveReward(const Board& before, const Board& after) {
+    double reward = 0.0;
+    for (int i = 0; i < N; i++) reward += rowScore(Packing::getRow(after, i)) - rowScore(Packing::getRow(before, i));
+    return reward;
+}
+
+template <int N, int BITS>
+float BoardEngine<N, BITS>::scoreTileChooseNode(EvalState& state, const Board& board, float cprob) {
+    if (cprob < CPROB_THRESH_BASE || state.curdepth >= state.depthLimit) {
+        state.maxdepth = max(state.curdepth, state.maxdepth);
+        return scoreHeurBoard(board);
+    }
+
+    if (state.curdepth < CACHE_DEPTH_LIMIT) {
+        state.cacheprobes++;
+        auto it = state.transTable.find(board);
+        if (it != state.transTable.end()) {
+            auto& entry = it->second;
+            if (entry.first <= state.curdepth) {
+                state.cachehits++;
+                return entry.second;
+            }
+        }
+    }
+
+    int numOpen = countEmpty(board);
+    if (numOpen == 0) return 0.0f;
+    cprob /= numOpen;
+
+    float res = 0.0f;
+    for (int i = 0; i < N && !aborted; i++) {
+        uint32_t row = Packing::getRow(board, i);
+        for (int j = 0; j < N; j++) {
+            if (((row >> (BITS * j)) & CELL_MASK) != 0) continue;
+            // 90%概率生成2，10%概率生成4
+            Board spawned = board;
+            Packing::setRow(spawned, i, row | (1u << (BITS * j)));
+            res += scoreMoveNode(state, spawned, cprob * 0.9f) * 0.9f;
+            Packing::setRow(spawned, i, row | (2u << (BITS * j)));
+            res += scoreMoveNode(state, spawned, cprob * 0.1f) * 0.1f;
+        }
+    }
+
+    res = res / numOpen;
+
+    if (state.curdepth < CACHE_DEPTH_LIMIT && !aborted) {
+        state.transTable[board] = { state.curdepth, res };
+    }
+
+    return res;
+}
+
+template <int N, int BITS>
+float BoardEngine<N, BITS>::scoreMoveNode(EvalState& state, const Board& board, float cprob) {
+    float best = 0.0f;
+    state.curdepth++;
+
+    for (int move = 0; move < 4; ++move) {
+        Board newboard = executeMove(move, board);
+        state.nodes++;
+
+        if (board != newboard) {
+            best = max(best, scoreTileChooseNode(state, newboard, cprob));
+        }
+    }
+
+    state.curdepth--;
+    if (cancelFlag && (state.nodes & 1023) == 0 && cancelFlag->load(memory_order_relaxed)) aborted = true;
+    return best;
+}
+
+template <int N, int BITS>
+pair<int, vector<float>> BoardEngine<N, BITS>::getBestMove(const vector<vector<int>>& grid, const atomic<bool>* cancel) {
+    auto start = chrono::steady_clock::now();
+    Board board = convertToBitboard(grid);
+    cancelFlag = cancel;
+    aborted = false;
+
+    EvalState state;
+    state.depthLimit = AI_OPTIONS.searchDepth > 0 ? AI_OPTIONS.searchDepth : max(3, countDistinctTiles(board) - 2);
+
+    vector<float> scores(4, 0.0f);
+    int bestMove = -1;
+    for (int move = 0; move < 4 && !aborted; move++) {
+        Board newboard = executeMove(move, board);
+        if (newboard == board) continue;
+        scores[move] = scoreTileChooseNode(state, newboard, 1.0f) + 1e-6f;
+        if (bestMove < 0 || scores[move] > scores[bestMove]) bestMove = move;
+    }
+
+    lastStats = SearchStats();
+    lastStats.nodes = state.nodes;
+    lastStats.cacheprobes = state.cacheprobes;
+    lastStats.cachehits = state.cachehits;
+    lastStats.maxdepth = state.maxdepth;
+    lastStats.completedDepth = aborted ? 0 : state.depthLimit;
+    lastStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    lastStats.ttEntries = state.transTable.size();
+    return { bestMove, scores };
+}
+
+bool needsWideBoard(const vector<vector<int>>& board) {
+    for (const auto& row : board) {
+        for (int value : row) {
+            if (value >= 32768) return true;
+        }
+    }
+    return false;
+}
+
+// 4位的4x4由AIEvaluator负责，其余组合全部实例化，保证每种编译配置都能通过编译
+template class BoardEngine<3>;
+template class BoardEngine<5>;
+template class BoardEngine<6>;
+template class BoardEngine<3, 5>;
+template class BoardEngine<4, 5>;
+template class BoardEngine<5, 5>;
+template class BoardEngine<6, 5>;
+
+// ==================== MCTSEngine实现 ====================
+
+MCTSEngine::DecisionNode::DecisionNode() : totalValue(0), visits(0) {
+    for (int i = 0; i < 4; i++) moves[i].store(nullptr, memory_order_relaxed);
+}
+
+MCTSEngine::ChanceNode::ChanceNode() : totalValue(0), visits(0) {
+    for (int i = 0; i < 32; i++) spawns[i].store(nullptr, memory_order_relaxed);
+}
+
+MCTSEngine::MCTSEngine(WorkStealingPool* searchPool) : pool(searchPool) {}
+
+// 子节点由首个到达的线程创建，竞争失败的线程丢弃自己刚分配的节点
+template <typename Node>
+Node* MCTSEngine::expand(atomic<Node*>& slot, deque<Node>& storage) {
+    Node* node = slot.load(memory_order_acquire);
+    if (node) return node;
+    storage.emplace_back();
+    Node* created = &storage.back();
+    if (slot.compare_exchange_strong(node, created, memory_order_acq_rel, memory_order_acquire)) return created;
+    storage.pop_back();
+    return node;
+}
+
+// 按启发式评分贪心走子，返回累计的合并得分
+int64_t MCTSEngine::rollout(uint64_t board, mt19937_64& rng) {
+    int64_t total = 0;
+    for (int step = 0; step < ROLLOUT_MOVES; step++) {
+        uint64_t after[4];
+        float scores[4];
+        AIEvaluator::executeAllMoves(board, after);
+        AIEvaluator::scoreHeurBoards(after, scores);
+
+        int bestMove = -1;
+        for (int move = 0; move < 4; move++) {
+            if (after[move] != board && (bestMove < 0 || scores[move] > scores[bestMove])) bestMove = move;
+        }
+        if (bestMove < 0) break;
+
+        total += static_cast<int64_t>(AIEvaluator::moveReward(board, after[bestMove]));
+        board = spawnRandomTile(after[bestMove], rng);
+    }
+    return total;
+}
+
+// 一次模拟：选择、扩展、走子、回传，返回本次到达的树深度。
+// 机会节点的价值含本步合并得分，因此决策节点直接比较各子节点的均值
+int MCTSEngine::simulate(DecisionNode* root, uint64_t board, Arena& arena, mt19937_64& rng) {
+    DecisionNode* decisions[MAX_TREE_DEPTH + 1];
+    ChanceNode* chances[MAX_TREE_DEPTH];
+    int64_t rewards[MAX_TREE_DEPTH];
+
+    DecisionNode* node = root;
+    int depth = 0;
+    int64_t value = 0;
+    while (true) {
+        decisions[depth] = node;
+        int32_t parentVisits = node->visits.fetch_add(VIRTUAL_LOSS, memory_order_relaxed);
+        if (depth > 0 && parentVisits == 0) {
+            value = rollout(board, rng);
+            break;
+        }
+        if (depth == MAX_TREE_DEPTH) {
+            value = rollout(board, rng);
+            break;
+        }
+
+        uint64_t after[4];
+        AIEvaluator::executeAllMoves(board, after);
+
+        // 未访问过的方向优先，其余按UCB1；探索项按兄弟节点的最大均值缩放，与得分量级无关
+        double means[4];
+        int32_t counts[4];
+        double scale = 1.0;
+        int move = -1;
+        for (int m = 0; m < 4; m++) {
+            counts[m] = -1;
+            if (after[m] == board) continue;
+            ChanceNode* child = node->moves[m].load(memory_order_acquire);
+            counts[m] = child ? child->visits.load(memory_order_relaxed) : 0;
+            if (counts[m] == 0) {
+                move = m;
+                break;
+            }
+            means[m] = static_cast<double>(child->totalValue.load(memory_order_relaxed)) / counts[m];
+            scale = max(scale, means[m]);
+        }
+        if (move < 0) {
+            double logParent = log(static_cast<double>(max(parentVisits, 1)));
+            double bestUcb = -1.0;
+            for (int m = 0; m < 4; m++) {
+                if (counts[m] < 0) continue;
+                double ucb = means[m] + EXPLORATION * scale * sqrt(logParent / counts[m]);
+                if (ucb > bestUcb) {
+                    bestUcb = ucb;
+                    move = m;
+                }
+            }
+        }
+        if (move < 0) break;    // 无路可走，后续价值为0
+
+        ChanceNode* chance = expand(node->moves[move], arena.chances);
+        chance->visits.fetch_add(VIRTUAL_LOSS, memory_order_relaxed);
+        chances[depth] = chance;
+        rewards[depth] = static_cast<int64_t>(AIEvaluator::moveReward(board, after[move]));
+
+        // 抽样出块：有效移动后必有空格
+        uint64_t afterstate = after[move];
+        int empty = 0;
+        for (int i = 0; i < 16; i++) empty += ((afterstate >> (4 * i)) & 0xf) == 0;
+        int target = static_cast<int>(rng() % empty);
+        int tile = (rng() % 10 == 0) ? 2 : 1;
+        int cell = 0;
+        for (; cell < 16; cell++) {
+            if (((afterstate >> (4 * cell)) & 0xf) == 0 && target-- == 0) break;
+        }
+        board = afterstate | (static_cast<uint64_t>(tile) << (4 * cell));
+
+        node = expand(chance->spawns[cell * 2 + tile - 1], arena.decisions);
+        depth++;
+    }
+
+    // 回传：扣回虚拟损失，补上真实的一次访问
+    for (int i = depth; i >= 0; i--) {
+        decisions[i]->totalValue.fetch_add(value, memory_order_relaxed);
+        decisions[i]->visits.fetch_add(1 - VIRTUAL_LOSS, memory_order_relaxed);
+        if (i > 0) {
+            value += rewards[i - 1];
+            chances[i - 1]->totalValue.fetch_add(value, memory_order_relaxed);
+            chances[i - 1]->visits.fetch_add(1 - VIRTUAL_LOSS, memory_order_relaxed);
+        }
+    }
+    return depth;
+}
+
+pair<int, vector<float>> MCTSEngine::getBestMove(uint64_t bitboard, const atomic<bool>* cancel) {
+    auto start = chrono::steady_clock::now();
+    int timeMs = AI_OPTIONS.moveTimeMs > 0 ? AI_OPTIONS.moveTimeMs : (AI_OPTIONS.moveNodes > 0 ? 0 : DEFAULT_TIME_MS);
+    auto deadline = start + chrono::milliseconds(timeMs);
+    unsigned long long nodeBudget = AI_OPTIONS.moveNodes;
+
+    unsigned workers = pool ? pool->size() : 0;
+    arenas.clear();
+    arenas.resize(workers + 1);
+    DecisionNode root;
+
+    atomic<unsigned long long> claimed(0);
+    atomic<unsigned long long> simulations(0);
+    atomic<int> maxDepth(0);
+
+    // 随机数按局面播种：单线程且按模拟次数限制预算时结果可复现
+    uint64_t seed = bitboard * 0x9E3779B97F4A7C15ULL;
+    auto worker = [&](unsigned index) {
+        mt19937_64 rng(seed + index);
+        unsigned long long count = 0;
+        int deepest = 0;
+        while (!(cancel && cancel->load(memory_order_relaxed))) {
+            if (nodeBudget > 0 && claimed.fetch_add(1, memory_order_relaxed) >= nodeBudget) break;
+            if (timeMs > 0 && chrono::steady_clock::now() >= deadline) break;
+            deepest = max(deepest, simulate(&root, bitboard, arenas[index], rng));
+            count++;
+        }
+        simulations += count;
+        int current = maxDepth.load();
+        while (deepest > current && !maxDepth.compare_exchange_weak(current, deepest)) {}
+    };
+
+    if (pool) {
+        TaskGroup group(*pool);
+        for (unsigned i = 0; i < workers; i++) group.run([&worker, i]() { worker(i); });
+        worker(workers);
+        group.wait();
+    }
+    else {
+        worker(0);
+    }
+
+    uint64_t after[4];
+    AIEvaluator::executeAllMoves(bitboard, after);
+    vector<float> scores(4, 0.0f);
+    int bestMove = -1;
+    int32_t bestVisits = -1;
+    for (int move = 0; move < 4; move++) {
+        if (after[move] == bitboard) continue;
+        ChanceNode* child = root.moves[move].load(memory_order_acquire);
+        int32_t visits = child ? child->visits.load() : 0;
+        // 加上极小值，保证有效方向的得分总是高于无效方向的0
+        scores[move] = (visits > 0 ? static_cast<float>(child->totalValue.load()) / visits : 0.0f) + 1e-6f;
+        if (visits > bestVisits || (visits == bestVisits && scores[move] > scores[bestMove])) {
+            bestVisits = visits;
+            bestMove = move;
+        }
+    }
+    arenas.clear();
+
+    lastStats = SearchStats();
+    lastStats.nodes = simulations.load();
+    lastStats.maxdepth = maxDepth.load();
+    lastStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return { bestMove, scores };
+}
+
+// ==================== OpeningBook实现 ====================
+
+bool OpeningBook::load(const string& path) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(OpeningBookHeader)) return false;
+
+    // 条目数由文件长度反推后再与文件头比较，损坏的entryCount相乘可能溢出而通过长度检查
+    OpeningBookHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    size_t payload = file.size() - sizeof(OpeningBookHeader);
+    if (memcmp(header.magic, "2048OB", 7) != 0 ||
+        header.version != OpeningBookHeader::VERSION ||
+        header.entrySize != sizeof(OpeningBookEntry) ||
+        payload % sizeof(OpeningBookEntry) != 0 ||
+        header.entryCount != payload / sizeof(OpeningBookEntry)) {
+        return false;
+    }
+
+    mapping.swap(file);
+    entries = reinterpret_cast<const OpeningBookEntry*>(mapping.data() + sizeof(OpeningBookHeader));
+    count = static_cast<size_t>(header.entryCount);
+    return true;
+}
+
+// 8种对称变换依次由可选的转置、左右翻转、上下翻转组成，移动方向随之变换
+uint64_t OpeningBook::canonicalize(uint64_t board, int moveMap[4]) {
+    static const int TRANSPOSE_MOVES[4] = { 2, 3, 0, 1 };
+    static const int FLIP_H_MOVES[4] = { 0, 1, 3, 2 };
+    static const int FLIP_V_MOVES[4] = { 1, 0, 2, 3 };
+
+    uint64_t best = board;
+    int bestSym = 0;
+    for (int sym = 1; sym < 8; sym++) {
+        uint64_t b = board;
+        if (sym & 1) b = AIEvaluator::transpose(b);
+        if (sym & 2) b = AIEvaluator::flipHorizontal(b);
+        if (sym & 4) b = AIEvaluator::flipVertical(b);
+        if (b < best) {
+            best = b;
+            bestSym = sym;
+        }
+    }
+
+    for (int move = 0; move < 4; move++) {
+        int mapped = move;
+        if (bestSym & 1) mapped = TRANSPOSE_MOVES[mapped];
+        if (bestSym & 2) mapped = FLIP_H_MOVES[mapped];
+        if (bestSym & 4) mapped = FLIP_V_MOVES[mapped];
+        moveMap[move] = mapped;
+    }
+    return best;
+}
+
+bool OpeningBook::lookup(uint64_t bitboard, pair<int, vector<float>>& out) const {
+    if (count == 0) return false;
+
+    int moveMap[4];
+    uint64_t key = canonicalize(bitboard, moveMap);
+    const OpeningBookEntry* end = entries + count;
+    const OpeningBookEntry* it = lower_bound(entries, end, key,
+        [](const OpeningBookEntry& entry, uint64_t board) { return entry.board < board; });
+    if (it == end || it->board != key) return false;
+
+    out.first = -1;
+    out.second.assign(4, 0.0f);
+    for (int move = 0; move < 4; move++) {
+        out.second[move] = it->scores[moveMap[move]];
+        if (moveMap[move] == it->bestMove) out.first = move;
+    }
+    return true;
+}
+
+// 先写临时文件再替换，与置换表快照相同
+bool OpeningBook::save(const string& path, vector<OpeningBookEntry> entries) {
+    sort(entries.begin(), entries.end(),
+        [](const OpeningBookEntry& a, const OpeningBookEntry& b) { return a.board < b.board; });
+
+    OpeningBookHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "2048OB", 7);
+    header.version = OpeningBookHeader::VERSION;
+    header.entrySize = sizeof(OpeningBookEntry);
+    header.entryCount = entries.size();
+
+    string tmpPath = path + ".tmp";
+    {
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(OpeningBookEntry));
+        if (!out) return false;
+    }
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+shared_ptr<const OpeningBook> sharedOpeningBook() {
+    static once_flag loaded;
+    static shared_ptr<const OpeningBook> book;
+    call_once(loaded, []() {
+        if (AI_OPTIONS.bookFile.empty()) return;
+        auto opened = make_shared<OpeningBook>();
+        if (opened->load(AI_OPTIONS.bookFile)) book = opened;
+    });
+    return book;
+}
+
+// ==================== AIAnalysisService实现 ====================
+
+// 分析线程在等待子任务时也会执行搜索任务，因此池中只需threads-1个工作线程
+AIAnalysisService::AIAnalysisService(unsigned threads, bool ponder) :
+    pool(threads > 1 ? new WorkStealingPool(threads - 1) : nullptr),
+    evaluator(pool.get(), BOARD_SIZE == 4 ? AI_OPTIONS.ttMegabytes : 0),   // 其他尺寸由BoardEngine搜索，置换表只留一个桶
+    book(sharedOpeningBook()), engine(AI_OPTIONS.engine),
+    stopping(false), hasRequest(false), pendingBoard(0), nextId(0), latestId(0), activeId(0),
+    pondering(false), ponderBoard(0), adoptedId(0),
+    cancelFlag(false), hasResult(false), ponderEnabled(ponder && BOARD_SIZE == 4) {
+    dispatcher = thread(&AIAnalysisService::run, this);
+}
+
+AIAnalysisService::~AIAnalysisService() {
+    shutdown();
 }
 
-// 初始化预计算表
-void AIEvaluator::initTables() {
-    static bool initialized = false;
-    if (initialized) return;
+void AIAnalysisService::shutdown() {
+    {
+        lock_guard<mutex> lock(m);
+        if (stopping) return;
+        stopping = true;
+        cancelFlag = true;
+    }
+    cv.notify_all();
+    resultCv.notify_all();
+    dispatcher.join();
+}
 
-    for (unsigned row = 0; row < 65536; ++row) {
-        unsigned line[4] = {
-            (row >> 0) & 0xf,
-            (row >> 4) & 0xf,
-            (row >> 8) & 0xf,
-            (row >> 12) & 0xf
-        };
+// 4x4以外的尺寸和需要宽棋盘的局面整盘交给BoardEngine，不参与预搜索
+uint64_t AIAnalysisService::submit(const vector<vector<int>>& board) {
+    if (BOARD_SIZE == 4 && !needsWideBoard(board)) return submit(AIEvaluator::convertToBitboard(board));
+    return submitRequest(0, vector<vector<int>>(board));
+}
 
-        // 实际得分
-        float score = 0.0f;
-        for (int i = 0; i < 4; ++i) {
-            int rank = line[i];
-            if (rank >= 2) {
-                score += (rank - 1) * (1 << rank);
-            }
-        }
-        scoreTable[row] = score;
+uint64_t AIAnalysisService::submit(uint64_t bitboard) {
+    return submitRequest(bitboard, vector<vector<int>>());
+}
 
-        // 启发式得分
-        float sum = 0;
-        int empty = 0;
-        int merges = 0;
-
-        int prev = 0;
-        int counter = 0;
-        for (int i = 0; i < 4; ++i) {
-            int rank = line[i];
-            sum += pow(rank, SCORE_SUM_POWER);
-            if (rank == 0) {
-                empty++;
-            }
-            else {
-                if (prev == rank) {
-                    counter++;
-                }
-                else if (counter > 0) {
-                    merges += 1 + counter;
-                    counter = 0;
-                }
-                prev = rank;
-            }
+// grid非空时按棋盘数值搜索（其他尺寸或宽方块），不参与预搜索
+uint64_t AIAnalysisService::submitRequest(uint64_t bitboard, vector<vector<int>>&& grid) {
+    bool useGrid = !grid.empty();
+    uint64_t id;
+    {
+        lock_guard<mutex> lock(m);
+        id = latestId = ++nextId;
+        hasRequest = false;
+        hasResult = false;
+        adoptedId = 0;
+        if (activeId != 0) cancelFlag = true;
+
+        unordered_map<uint64_t, Result>::iterator it = useGrid ? ponderCache.end() : ponderCache.find(bitboard);
+        if (it != ponderCache.end()) {
+            // 预搜索命中：立即发布结果，并从这个局面继续预搜索下一步
+            Result res = std::move(it->second);
+            res.requestId = id;
+            int bestMove = res.bestMove;
+            publish(std::move(res));
+            startPonder(bitboard, bestMove);
+            if (pondering) cancelFlag = true;
         }
-        if (counter > 0) {
-            merges += 1 + counter;
+        else if (!useGrid && pondering && ponderBoard == bitboard) {
+            // 正在预搜索的恰好是这个局面，直接接管其结果
+            ponderQueue.clear();
+            ponderCache.clear();
+            adoptedId = id;
         }
-
-        float monotonicity_left = 0;
-        float monotonicity_right = 0;
-        for (int i = 1; i < 4; ++i) {
-            if (line[i - 1] > line[i]) {
-                monotonicity_left += pow(line[i - 1], SCORE_MONOTONICITY_POWER) - pow(line[i], SCORE_MONOTONICITY_POWER);
-            }
-            else {
-                monotonicity_right += pow(line[i], SCORE_MONOTONICITY_POWER) - pow(line[i - 1], SCORE_MONOTONICITY_POWER);
-            }
+        else {
+            ponderQueue.clear();
+            ponderCache.clear();
+            pendingBoard = bitboard;
+            pendingGrid = std::move(grid);
+            hasRequest = true;
+            if (pondering) cancelFlag = true;
         }
+    }
+    cv.notify_one();
+    return id;
+}
 
-        heurScoreTable[row] = SCORE_LOST_PENALTY +
-            SCORE_EMPTY_WEIGHT * empty +
-            SCORE_MERGES_WEIGHT * merges -
-            SCORE_MONOTONICITY_WEIGHT * min(monotonicity_left, monotonicity_right) -
-            SCORE_SUM_WEIGHT * sum;
-
-        // 执行左移操作
-        unsigned new_line[4] = { line[0], line[1], line[2], line[3] };
-        for (int i = 0; i < 3; ++i) {
-            int j;
-            for (j = i + 1; j < 4; ++j) {
-                if (new_line[j] != 0) break;
-            }
-            if (j == 4) break;
+void AIAnalysisService::cancel() {
+    lock_guard<mutex> lock(m);
+    hasRequest = false;
+    hasResult = false;
+    adoptedId = 0;
+    latestId = ++nextId;
+    ponderQueue.clear();
+    ponderCache.clear();
+    if (activeId != 0 || pondering) cancelFlag = true;
+}
 
-            if (new_line[i] == 0) {
-                new_line[i] = new_line[j];
-                new_line[j] = 0;
-                i--;
-            }
-            else if (new_line[i] == new_line[j]) {
-                if (new_line[i] != 0xf) {
-                    new_line[i]++;
-                }
-                new_line[j] = 0;
-            }
-        }
+bool AIAnalysisService::poll(Result& out) {
+    lock_guard<mutex> lock(m);
+    if (!hasResult) return false;
+    out = std::move(result);
+    hasResult = false;
+    return true;
+}
 
-        uint16_t result = (new_line[0] << 0) | (new_line[1] << 4) | (new_line[2] << 8) | (new_line[3] << 12);
-        uint16_t rev_result = reverseRow(result);
-        unsigned rev_row = reverseRow(static_cast<uint16_t>(row));
+bool AIAnalysisService::waitResult(int timeoutMs) {
+    unique_lock<mutex> lock(m);
+    return resultCv.wait_for(lock, chrono::milliseconds(timeoutMs),
+        [this]() { return hasResult || stopping; }) && hasResult;
+}
 
-        rowLeftTable[row] = row ^ result;
-        rowRightTable[rev_row] = rev_row ^ rev_result;
-        colUpTable[row] = unpackCol(row) ^ unpackCol(result);
-        colDownTable[rev_row] = unpackCol(rev_row) ^ unpackCol(rev_result);
-    }
+void AIAnalysisService::setEngine(AIEngine newEngine) {
+    lock_guard<mutex> lock(m);
+    if (engine == newEngine) return;
+    engine = newEngine;
+    ponderQueue.clear();
+    ponderCache.clear();
+    adoptedId = 0;
+    if (pondering) cancelFlag = true;
+}
 
-    initialized = true;
+AIEngine AIAnalysisService::getEngine() {
+    lock_guard<mutex> lock(m);
+    return engine;
 }
 
-// 执行移动
-uint64_t AIEvaluator::executeMove(int move, uint64_t board) {
-    switch (move) {
-    case 0: { // up
-        uint64_t ret = board;
-        uint64_t t = transpose(board);
-        ret ^= colUpTable[(t >> 0) & 0xFFFF] << 0;
-        ret ^= colUpTable[(t >> 16) & 0xFFFF] << 4;
-        ret ^= colUpTable[(t >> 32) & 0xFFFF] << 8;
-        ret ^= colUpTable[(t >> 48) & 0xFFFF] << 12;
-        return ret;
-    }
-    case 1: { // down
-        uint64_t ret = board;
-        uint64_t t = transpose(board);
-        ret ^= colDownTable[(t >> 0) & 0xFFFF] << 0;
-        ret ^= colDownTable[(t >> 16) & 0xFFFF] << 4;
-        ret ^= colDownTable[(t >> 32) & 0xFFFF] << 8;
-        ret ^= colDownTable[(t >> 48) & 0xFFFF] << 12;
-        return ret;
-    }
-    case 2: { // left
-        uint64_t ret = board;
-        ret ^= static_cast<uint64_t>(rowLeftTable[(board >> 0) & 0xFFFF]) << 0;
-        ret ^= static_cast<uint64_t>(rowLeftTable[(board >> 16) & 0xFFFF]) << 16;
-        ret ^= static_cast<uint64_t>(rowLeftTable[(board >> 32) & 0xFFFF]) << 32;
-        ret ^= static_cast<uint64_t>(rowLeftTable[(board >> 48) & 0xFFFF]) << 48;
-        return ret;
+// 在服务线程中调用，不持有锁
+pair<int, vector<float>> AIAnalysisService::search(AIEngine which, uint64_t board, const vector<vector<int>>& grid,
+    SearchStats& stats) {
+    pair<int, vector<float>> best;
+    if (!grid.empty()) {
+        if (needsWideBoard(grid)) {
+            best = wideEngine.getBestMove(grid, &cancelFlag);
+            stats = wideEngine.getLastStats();
+        }
+        else {
+            best = sizedEngine.getBestMove(grid, &cancelFlag);
+            stats = sizedEngine.getLastStats();
+        }
+        return best;
     }
-    case 3: { // right
-        uint64_t ret = board;
-        ret ^= static_cast<uint64_t>(rowRightTable[(board >> 0) & 0xFFFF]) << 0;
-        ret ^= static_cast<uint64_t>(rowRightTable[(board >> 16) & 0xFFFF]) << 16;
-        ret ^= static_cast<uint64_t>(rowRightTable[(board >> 32) & 0xFFFF]) << 32;
-        ret ^= static_cast<uint64_t>(rowRightTable[(board >> 48) & 0xFFFF]) << 48;
-        return ret;
+    if (book && book->lookup(board, best)) {
+        stats = SearchStats();
+        stats.book = true;
+        return best;
     }
-    default:
-        return ~0ULL;
+    if (which == AIEngine::MCTS) {
+        if (!mcts) mcts.reset(new MCTSEngine(pool.get()));
+        best = mcts->getBestMove(board, &cancelFlag);
+        stats = mcts->getLastStats();
+        return best;
     }
+    best = evaluator.getBestMove(board, &cancelFlag);
+    stats = evaluator.getLastStats();
+    return best;
 }
 
-// 递归评估函数
-float AIEvaluator::scoreTileChooseNode(EvalState& state, uint64_t board, float cprob) {
-    if (cprob < CPROB_THRESH_BASE || state.curdepth >= state.depth_limit) {
-        state.maxdepth = max(state.curdepth, state.maxdepth);
-        return scoreHeurBoard(board);
-    }
+// 调用时需持有锁
+void AIAnalysisService::publish(Result&& res) {
+    result = std::move(res);
+    hasResult = true;
+    resultCv.notify_all();
+}
 
-    if (state.curdepth < CACHE_DEPTH_LIMIT) {
-        auto it = state.transTable.find(board);
-        if (it != state.transTable.end()) {
-            auto& entry = it->second;
-            if (entry.first <= state.curdepth) {
-                state.cachehits++;
-                return entry.second;
+// 调用时需持有锁。按最佳着法走一步后枚举所有出块结果：
+// 每个空格出2的概率为0.9/n、出4为0.1/n，因此先排全部出2的局面
+void AIAnalysisService::startPonder(uint64_t board, int bestMove) {
+    ponderQueue.clear();
+    ponderCache.clear();
+    if (!ponderEnabled || bestMove < 0) return;
+
+    uint64_t afterstate = AIEvaluator::executeMove(bestMove, board);
+    if (afterstate == board) return;
+
+    for (uint64_t tile = 1; tile <= 2; tile++) {
+        for (int i = 0; i < 16; i++) {
+            if (((afterstate >> (4 * i)) & 0xf) == 0) {
+                ponderQueue.push_back(afterstate | (tile << (4 * i)));
             }
         }
     }
+}
 
-    int num_open = countEmpty(board);
-    if (num_open == 0) return 0.0f;
-    cprob /= num_open;
+void AIAnalysisService::run() {
+    unique_lock<mutex> lock(m);
+    while (true) {
+        cv.wait(lock, [this]() { return stopping || hasRequest || !ponderQueue.empty(); });
+        if (stopping) return;
+
+        if (hasRequest) {
+            uint64_t board = pendingBoard;
+            vector<vector<int>> grid = std::move(pendingGrid);
+            uint64_t id = activeId = latestId;
+            AIEngine which = engine;
+            hasRequest = false;
+            cancelFlag = false;
+            lock.unlock();
+
+            SearchStats stats;
+            pair<int, vector<float>> best = search(which, board, grid, stats);
+
+            lock.lock();
+            activeId = 0;
+            if (!cancelFlag && id == latestId) {
+                Result res;
+                res.requestId = id;
+                res.bestMove = best.first;
+                res.scores = std::move(best.second);
+                res.stats = stats;
+                publish(std::move(res));
+                if (grid.empty()) startPonder(board, best.first);
+            }
+            continue;
+        }
 
-    float res = 0.0f;
-    uint64_t tmp = board;
-    uint64_t tile_2 = 1;
-    int count = 0;
+        // 没有真实请求时才处理预搜索，真实请求到来会取消当前预搜索
+        uint64_t board = ponderBoard = ponderQueue.front();
+        ponderQueue.pop_front();
+        if (ponderCache.count(board)) continue;
+        pondering = true;
+        AIEngine which = engine;
+        cancelFlag = false;
+        lock.unlock();
+
+        SearchStats stats;
+        pair<int, vector<float>> best = search(which, board, {}, stats);
+
+        lock.lock();
+        pondering = false;
+        if (cancelFlag) {
+            adoptedId = 0;
+            continue;
+        }
 
-    while (tile_2 && count < num_open) {
-        if ((tmp & 0xf) == 0) {
-            // 90%概率生成2，10%概率生成4
-            res += scoreMoveNode(state, board | tile_2, cprob * 0.9f) * 0.9f;
-            res += scoreMoveNode(state, board | (tile_2 << 1), cprob * 0.1f) * 0.1f;
-            count++;
+        Result res;
+        res.bestMove = best.first;
+        res.scores = std::move(best.second);
+        res.stats = stats;
+        res.pondered = true;
+        if (adoptedId != 0) {
+            if (adoptedId == latestId) {
+                res.requestId = adoptedId;
+                publish(std::move(res));
+                startPonder(board, best.first);
+            }
+            adoptedId = 0;
+        }
+        else {
+            ponderCache[board] = std::move(res);
         }
-        tmp >>= 4;
-        tile_2 <<= 4;
     }
+}
 
-    res = res / num_open;
-
-    if (state.curdepth < CACHE_DEPTH_LIMIT) {
-        state.transTable[board] = { state.curdepth, res };
-    }
+// ==================== GameBoard实现 ====================
 
-    return res;
+template <int BITS, typename Board>
+static int boardCellRank(const Board& board, int row, int col) {
+    return (BoardPacking<BOARD_SIZE, BITS>::getRow(board, row) >> (BITS * col)) & ((1u << BITS) - 1);
 }
 
-float AIEvaluator::scoreMoveNode(EvalState& state, uint64_t board, float cprob) {
-    float best = 0.0f;
-    state.curdepth++;
+template <int BITS, typename Board>
+static void setBoardCellRank(Board& board, int row, int col, unsigned rank) {
+    typedef BoardPacking<BOARD_SIZE, BITS> Packing;
+    uint32_t line = Packing::getRow(board, row) & ~(((1u << BITS) - 1) << (BITS * col));
+    Packing::setRow(board, row, line | (rank << (BITS * col)));
+}
 
-    for (int move = 0; move < 4; ++move) {
-        uint64_t newboard = executeMove(move, board);
-        state.moves_evaled++;
+template <typename Engine, typename Board>
+static bool applyBoardMove(Board& board, int direction, int& score) {
+    Board after = Engine::executeMove(direction, board);
+    if (after == board) return false;
+    score += static_cast<int>(Engine::moveReward(board, after));
+    board = after;
+    return true;
+}
 
-        if (board != newboard) {
-            best = max(best, scoreTileChooseNode(state, newboard, cprob));
-        }
+template <typename Engine, typename Board>
+static bool anyBoardMove(const Board& board) {
+    for (int direction = 0; direction < 4; direction++) {
+        if (!(Engine::executeMove(direction, board) == board)) return true;
     }
+    return false;
+}
 
-    state.curdepth--;
-    return best;
+// 只有4x4的4位棋盘与AIEvaluator的布局相同
+template <typename Board>
+static uint64_t packedBitboard(const Board& board) { return board; }
+template <size_t Rows>
+static uint64_t packedBitboard(const array<uint32_t, Rows>&) { return 0; }
+
+GameBoard::GameBoard() : narrow(), wideBoard(), isWide(false) {}
+
+GameBoard GameBoard::fromGrid(const vector<vector<int>>& grid) {
+    GameBoard board;
+    for (int i = 0; i < BOARD_SIZE; i++)
+        for (int j = 0; j < BOARD_SIZE; j++)
+            board.set(i, j, grid[i][j]);
+    return board;
 }
 
-float AIEvaluator::scoreTopLevelMove(uint64_t board, int move) {
-    uint64_t newboard = executeMove(move, board);
+vector<vector<int>> GameBoard::toGrid() const {
+    vector<vector<int>> grid(BOARD_SIZE, vector<int>(BOARD_SIZE, 0));
+    for (int i = 0; i < BOARD_SIZE; i++)
+        for (int j = 0; j < BOARD_SIZE; j++)
+            grid[i][j] = get(i, j);
+    return grid;
+}
 
-    if (board == newboard) return 0.0f;
+int GameBoard::getRank(int row, int col) const {
+    return isWide ? boardCellRank<5>(wideBoard, row, col) : boardCellRank<4>(narrow, row, col);
+}
 
-    EvalState state(transTable);
-    state.depth_limit = max(3, countDistinctTiles(board) - 2);
+void GameBoard::set(int row, int col, int value) {
+    unsigned rank = 0;
+    while (rank < WideEngine::CELL_MASK && (value >> (rank + 1)) > 0) rank++;
+    if (!isWide && rank >= WIDE_RANK) widen();
+    if (isWide) setBoardCellRank<5>(wideBoard, row, col, rank);
+    else setBoardCellRank<4>(narrow, row, col, rank);
+}
 
-    return scoreTileChooseNode(state, newboard, 1.0f) + 1e-6;
+// 逐格拷贝到5位棋盘，之后一直使用5位棋盘
+void GameBoard::widen() {
+    for (int i = 0; i < BOARD_SIZE; i++)
+        for (int j = 0; j < BOARD_SIZE; j++)
+            setBoardCellRank<5>(wideBoard, i, j, boardCellRank<4>(narrow, i, j));
+    isWide = true;
 }
 
-// 棋盘表示转换函数
-uint64_t AIEvaluator::convertToBitboard(const vector<vector<int>>& board) {
-    uint64_t bitboard = 0;
+bool GameBoard::move(int direction, int& score) {
+    if (isWide) return applyBoardMove<WideEngine>(wideBoard, direction, score);
+    if (!applyBoardMove<NarrowEngine>(narrow, direction, score)) return false;
+    if (maxTile() >= (1 << WIDE_RANK)) widen();
+    return true;
+}
 
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            int value = board[i][j];
-            int tile = 0;
+bool GameBoard::canMove() const {
+    return isWide ? anyBoardMove<WideEngine>(wideBoard) : anyBoardMove<NarrowEngine>(narrow);
+}
 
-            if (value > 0) {
-                tile = static_cast<int>(_2logMap[value]);
-                if (tile > 15) tile = 15;
-            }
+int GameBoard::countEmpty() const {
+    int empty = 0;
+    for (int i = 0; i < BOARD_SIZE; i++)
+        for (int j = 0; j < BOARD_SIZE; j++)
+            empty += getRank(i, j) == 0;
+    return empty;
+}
 
-            int shift = (i * 4 + j) * 4;
-            bitboard |= static_cast<uint64_t>(tile) << shift;
+void GameBoard::placeInEmpty(int index, int value) {
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            if (getRank(i, j) == 0 && index-- == 0) {
+                set(i, j, value);
+                return;
+            }
         }
     }
+}
 
-    return bitboard;
+int GameBoard::maxTile() const {
+    int maxRank = 0;
+    for (int i = 0; i < BOARD_SIZE; i++)
+        for (int j = 0; j < BOARD_SIZE; j++)
+            maxRank = max(maxRank, getRank(i, j));
+    return maxRank ? 1 << maxRank : 0;
 }
 
-// 评估四个方向的得分
-vector<float> AIEvaluator::evaluateAllMoves(const vector<vector<int>>& board) {
-    initTables();
-    transTable.clear();
+bool GameBoard::hasTile(int value) const {
+    for (int i = 0; i < BOARD_SIZE; i++)
+        for (int j = 0; j < BOARD_SIZE; j++)
+            if (get(i, j) == value) return true;
+    return false;
+}
 
-    uint64_t bitboard = convertToBitboard(board);
-    vector<float> scores(4, 0.0f);
+uint64_t GameBoard::bitboard() const {
+    return hasBitboard() ? packedBitboard(narrow) : 0;
+}
 
-    for (int move = 0; move < 4; move++) {
-        scores[move] = scoreTopLevelMove(bitboard, move);
+// ==================== GameHistory实现 ====================
+
+void GameHistory::reset(const GameBoard& board, int score, int highScore, bool won) {
+    count = 0;
+    current = NONE;
+    record(board, score, highScore, won);
+}
+
+void GameHistory::record(const GameBoard& board, int score, int highScore, bool won) {
+    if (current != NONE) {
+        for (uint32_t child = at(current).firstChild; child != NONE; child = at(child).nextSibling) {
+            if (at(child).score == score && at(child).board == board) {
+                at(current).redoChild = child;
+                current = child;
+                return;
+            }
+        }
     }
 
-    return scores;
+    if (count / CHUNK_SIZE == chunks.size()) chunks.emplace_back(new Entry[CHUNK_SIZE]);
+    uint32_t index = count++;
+    Entry& entry = at(index);
+    entry.board = board;
+    entry.score = score;
+    entry.highScore = highScore;
+    entry.won = won;
+    entry.parent = current;
+    entry.firstChild = NONE;
+    entry.redoChild = NONE;
+    entry.nextSibling = NONE;
+    if (current != NONE) {
+        entry.nextSibling = at(current).firstChild;
+        at(current).firstChild = index;
+        at(current).redoChild = index;
+    }
+    current = index;
 }
 
-// 获取最佳移动建议
-pair<int, vector<float>> AIEvaluator::getBestMove(const vector<vector<int>>& board) {
-    vector<float> scores = evaluateAllMoves(board);
+bool GameHistory::undo(GameBoard& board, int& score, int& highScore, bool& won) {
+    if (current == NONE || at(current).parent == NONE) return false;
+    current = at(current).parent;
+    board = at(current).board;
+    score = at(current).score;
+    highScore = at(current).highScore;
+    won = at(current).won;
+    return true;
+}
 
-    int bestMove = -1;
-    float bestScore = -1.0f;
+bool GameHistory::redo(GameBoard& board, int& score, int& highScore, bool& won) {
+    if (current == NONE || at(current).redoChild == NONE) return false;
+    current = at(current).redoChild;
+    board = at(current).board;
+    score = at(current).score;
+    highScore = at(current).highScore;
+    won = at(current).won;
+    return true;
+}
 
-    for (int i = 0; i < 4; i++) {
-        if (scores[i] > bestScore) {
-            bestScore = scores[i];
-            bestMove = i;
-        }
-    }
+int GameHistory::switchBranch() {
+    if (branchCount() < 2) return 0;
+    Entry& entry = at(current);
+    uint32_t next = at(entry.redoChild).nextSibling;
+    entry.redoChild = next != NONE ? next : entry.firstChild;
 
-    return { bestMove, scores };
+    int position = 1;
+    for (uint32_t child = entry.firstChild; child != entry.redoChild; child = at(child).nextSibling) position++;
+    return position;
+}
+
+int GameHistory::branchCount() const {
+    if (current == NONE) return 0;
+    int branches = 0;
+    for (uint32_t child = at(current).firstChild; child != NONE; child = at(child).nextSibling) branches++;
+    return branches;
 }
 
 // ==================== Game2048实现 ====================
 
 Game2048::Game2048() :
     MIN_TERM_WIDTH(BOARD_SIZE* CELL_WIDTH + (BOARD_SIZE - 1) + 4),
-    MIN_TERM_HEIGHT(6 + BOARD_SIZE * (CELL_HEIGHT + 1) + 3) {
+    MIN_TERM_HEIGHT(6 + BOARD_SIZE * (CELL_HEIGHT + 1) + 3),
+    aiService(configuredThreadCount()) {
 
     srand(time(0));
     score = 0;
@@ -501,11 +2757,12 @@ Game2048::Game2048() :
     // 初始化AI相关变量
     moveScores = vector<float>(4, 0.0f);
     aiBestMove = -1;
+    aiRequestId = 0;
     openAI = false;
     aiAutoMode = false;
     aiAutoMoveDelay = 0;
     aiEvaluating = false;
-    aiCancelFlag = false;
+    aiPondered = false;
 
     // 初始化数字点阵
     numberPatterns = {
@@ -528,10 +2785,24 @@ Game2048::Game2048() :
     initBoard();
     updateTerminalSize();
     resetFrameBuffer();
+
+    if (!AI_OPTIONS.ttFile.empty()) {
+        aiService.loadTableSnapshot(AI_OPTIONS.ttFile);
+    }
+}
+
+Game2048::~Game2048() {
+    // 先停止分析服务，再保存置换表快照
+    aiService.shutdown();
+    if (!AI_OPTIONS.ttFile.empty()) {
+        aiService.saveTableSnapshot(AI_OPTIONS.ttFile);
+    }
 }
 
 // 初始化语言字符串
 void Game2048::initLanguageStrings() {
+    const string size = to_string(BOARD_SIZE);
+
     // 中文字符串
     chineseStrings["title"] = "2048";
     chineseStrings["current_score"] = "当前分数: ";
@@ -542,16 +2813,22 @@ void Game2048::initLanguageStrings() {
     chineseStrings["ai_evaluating"] = "AI评估: 计算中...";
     chineseStrings["ai_eval"] = "AI评估: ";
     chineseStrings["no_valid_move"] = "无可行移动";
+    chineseStrings["cache_hit_rate"] = "缓存命中";
+    chineseStrings["pondered"] = "预搜索";
+    chineseStrings["opening_book"] = "开局库";
+    chineseStrings["search_nodes"] = "节点";
+    chineseStrings["search_depth"] = "深度";
+    chineseStrings["tt_fill"] = "置换表占用";
     chineseStrings["congrats_2048"] = "恭喜！你已经达到 2048！可以继续游戏！";
     chineseStrings["terminal_too_small"] = "⚠️  终端尺寸不足！最小要求：宽";
     chineseStrings["resize_terminal"] = "请放大终端窗口后，按任意键重绘...（windows系统可以按ctrl+滚轮缩放终端）";
     chineseStrings["practice_mode"] = "练习模式";
-    chineseStrings["practice_instructions"] = "请输入一个4x4的局面，每个位置输入0-16的数字：\n"
+    chineseStrings["practice_instructions"] = "请输入一个" + size + "x" + size + "的局面，每个位置输入0-16的数字：\n"
                                              "  0表示空位，1表示2，2表示4，...，16表示65536\n"
                                              "  输入示例：第一行: 0 0 0 0，第二行: 0 2 0 0\n"
                                              "  输入-1取消并返回原局面";
     chineseStrings["enter_row"] = "第";
-    chineseStrings["row"] = "行（4个数字，空格分隔）: ";
+    chineseStrings["row"] = "行（" + size + "个数字，空格分隔）: ";
     chineseStrings["invalid_input"] = "输入格式错误！";
     chineseStrings["number_range_error"] = "错误：数字必须在0-16之间！";
     chineseStrings["empty_board_error"] = "错误：局面不能全为空！";
@@ -564,7 +2841,7 @@ void Game2048::initLanguageStrings() {
                                          "  • 按R键重新开始游戏将退出练习模式";
     chineseStrings["enter_spawn_params"] = "请输入强制生成参数（数字 行 列，用空格分隔，按Enter确认）：";
     chineseStrings["spawn_error_num"] = "输入错误：第一个数必须是2或4！";
-    chineseStrings["spawn_error_pos"] = "输入错误：行和列必须是1-4之间的数字！";
+    chineseStrings["spawn_error_pos"] = "输入错误：行和列必须是1-" + size + "之间的数字！";
     chineseStrings["spawn_success"] = "下次将生成";
     chineseStrings["at_row"] = " 在第";
     chineseStrings["column"] = "行第";
@@ -574,8 +2851,11 @@ void Game2048::initLanguageStrings() {
     chineseStrings["move_controls"] = "方向键 (↑ ↓ ← →) 或 WASD 键移动方块";
     chineseStrings["quit_restart"] = "Q 键 - 退出游戏    R 键 - 重新开始";
     chineseStrings["save_load"] = "M 键 - 保存游戏    L 键 - 读取存档";
-    chineseStrings["practice_controls"] = "P 键 - 练习模式    Z 键 - 练习模式下撤销    K 键 - 练习模式指定生成位置";
-    chineseStrings["ai_controls"] = "I 键 - 切换AI评估显示    0 键 - 开启/关闭AI自动模式";
+    chineseStrings["practice_controls"] = "P 键 - 练习模式    K 键 - 练习模式指定生成位置";
+    chineseStrings["history_controls"] = "Z 键 - 撤销    Y 键 - 重做    B 键 - 切换重做分支";
+    chineseStrings["redo_branch"] = "重做分支: ";
+    chineseStrings["no_branches"] = "这里没有可切换的分支！";
+    chineseStrings["ai_controls"] = "I 键 - 切换AI评估显示    0 键 - 开启/关闭AI自动模式    C 键 - 切换搜索引擎";
     chineseStrings["save_game"] = "保存游戏";
     chineseStrings["confirm_save"] = "是否保存当前游戏进度？(y/n): ";
     chineseStrings["save_cancelled"] = "取消保存操作。";
@@ -591,6 +2871,7 @@ void Game2048::initLanguageStrings() {
     chineseStrings["high_score"] = "最高分数: ";
     chineseStrings["congratulations"] = "🎉 恭喜你获胜了！";
     chineseStrings["no_moves_left"] = "没有可移动的方向了！";
+    chineseStrings["game_over_undo"] = "按Z撤销最后一步，按其他键结束: ";
     chineseStrings["thanks_for_playing"] = "感谢游玩！再见！";
     chineseStrings["play_again"] = "是否重新开始游戏？(y/n): ";
     chineseStrings["ai_no_move"] = "AI无有效移动，自动模式已关闭";
@@ -609,16 +2890,22 @@ void Game2048::initLanguageStrings() {
     englishStrings["ai_evaluating"] = "AI Evaluating: Calculating...";
     englishStrings["ai_eval"] = "AI Eval: ";
     englishStrings["no_valid_move"] = "No valid move";
+    englishStrings["cache_hit_rate"] = "TT hits";
+    englishStrings["pondered"] = "pondered";
+    englishStrings["opening_book"] = "opening book";
+    englishStrings["search_nodes"] = "nodes";
+    englishStrings["search_depth"] = "depth";
+    englishStrings["tt_fill"] = "TT used";
     englishStrings["congrats_2048"] = "Congratulations! You've reached 2048! You can continue!";
     englishStrings["terminal_too_small"] = "⚠️  Terminal too small! Minimum required: width ";
     englishStrings["resize_terminal"] = "Please resize terminal and press any key... (Windows: ctrl+mouse wheel)";
     englishStrings["practice_mode"] = "Practice Mode";
-    englishStrings["practice_instructions"] = "Enter a 4x4 board state, input 0-16 for each position:\n"
+    englishStrings["practice_instructions"] = "Enter a " + size + "x" + size + " board state, input 0-16 for each position:\n"
                                             "  0 for empty, 1 for 2, 2 for 4, ..., 16 for 65536\n"
                                             "  Example: Row 1: 0 0 0 0, Row 2: 0 2 0 0\n"
                                             "  Enter -1 to cancel and return to original board";
     englishStrings["enter_row"] = "Row ";
-    englishStrings["row"] = " (4 numbers, space separated): ";
+    englishStrings["row"] = " (" + size + " numbers, space separated): ";
     englishStrings["invalid_input"] = "Invalid input format!";
     englishStrings["number_range_error"] = "Error: Numbers must be between 0-16!";
     englishStrings["empty_board_error"] = "Error: Board cannot be completely empty!";
@@ -630,7 +2917,7 @@ void Game2048::initLanguageStrings() {
                                          "  • R key - Restart game will exit practice mode";
     englishStrings["enter_spawn_params"] = "Enter forced spawn parameters (number row column, space separated, press Enter): ";
     englishStrings["spawn_error_num"] = "Error: First number must be 2 or 4!";
-    englishStrings["spawn_error_pos"] = "Error: Row and column must be numbers 1-4!";
+    englishStrings["spawn_error_pos"] = "Error: Row and column must be numbers 1-" + size + "!";
     englishStrings["spawn_success"] = "Next will spawn ";
     englishStrings["at_row"] = " at row ";
     englishStrings["column"] = ", column ";
@@ -640,8 +2927,11 @@ void Game2048::initLanguageStrings() {
     englishStrings["move_controls"] = "Arrow keys (↑ ↓ ← →) or WASD to move tiles";
     englishStrings["quit_restart"] = "Q key - Quit game    R key - Restart";
     englishStrings["save_load"] = "M key - Save game    L key - Load game";
-    englishStrings["practice_controls"] = "P key - Practice mode    Z key - Undo in practice mode    K key - Set spawn in practice mode";
-    englishStrings["ai_controls"] = "I key - Toggle AI evaluation    0 key - Toggle AI auto mode";
+    englishStrings["practice_controls"] = "P key - Practice mode    K key - Set spawn in practice mode";
+    englishStrings["history_controls"] = "Z key - Undo    Y key - Redo    B key - Switch redo branch";
+    englishStrings["redo_branch"] = "Redo branch: ";
+    englishStrings["no_branches"] = "No branches to switch here!";
+    englishStrings["ai_controls"] = "I key - Toggle AI evaluation    0 key - Toggle AI auto mode    C key - Switch search engine";
     englishStrings["save_game"] = "Save Game";
     englishStrings["confirm_save"] = "Save current game progress? (y/n): ";
     englishStrings["save_cancelled"] = "Save cancelled.";
@@ -657,6 +2947,7 @@ void Game2048::initLanguageStrings() {
     englishStrings["high_score"] = "High Score: ";
     englishStrings["congratulations"] = "🎉 Congratulations! You won!";
     englishStrings["no_moves_left"] = "No moves available!";
+    englishStrings["game_over_undo"] = "Press Z to undo the last move, any other key to finish: ";
     englishStrings["thanks_for_playing"] = "Thanks for playing! Goodbye!";
     englishStrings["play_again"] = "Play again? (y/n): ";
     englishStrings["ai_no_move"] = "AI has no valid move, auto mode disabled";
@@ -734,13 +3025,11 @@ bool Game2048::isTerminalSizeEnough() {
 
 // 初始化棋盘
 void Game2048::initBoard() {
-    board.resize(BOARD_SIZE, vector<int>(BOARD_SIZE, 0));
-    prevBoard.resize(BOARD_SIZE, vector<int>(BOARD_SIZE, -1));
+    board = GameBoard();
+    prevBoard = GameBoard();
     score = 0;
     prevScore = -1;
     practiceMode = false;
-    practiceHistory.clear();
-    practiceHistoryScores.clear();
     forcedSpawnNum = 0;
     forcedSpawnX = -1;
     forcedSpawnY = -1;
@@ -751,17 +3040,17 @@ void Game2048::initBoard() {
             for (int j = 0; j < BOARD_SIZE; j++) {
                 int j_ = j;
                 if (i % 2) { j_ = BOARD_SIZE - j - 1; }
-                board[i][j] = _2PowerMap[i * BOARD_SIZE + j_ + 1];
+                board.set(i, j, _2PowerMap[i * BOARD_SIZE + j_ + 1]);
             }
         }
         //board[0][0] = 4;
     }
     addRandomTile();
     addRandomTile();
+    history.reset(board, score, highScore, haveWonFlag);
 
     // 初始化AI评估状态
     aiEvaluating = false;
-    aiCancelFlag = false;
     moveScores = vector<float>(4, 0.0f);
     aiBestMove = -1;
 }
@@ -770,8 +3059,8 @@ void Game2048::initBoard() {
 void Game2048::addRandomTile() {
     // 先检查是否有强制生成的要求
     if (practiceMode && forcedSpawnNum != 0 && forcedSpawnX >= 0 && forcedSpawnY >= 0) {
-        if (board[forcedSpawnX][forcedSpawnY] == 0) {
-            board[forcedSpawnX][forcedSpawnY] = forcedSpawnNum;
+        if (board.get(forcedSpawnX, forcedSpawnY) == 0) {
+            board.set(forcedSpawnX, forcedSpawnY, forcedSpawnNum);
             forcedSpawnNum = 0;
             forcedSpawnX = -1;
             forcedSpawnY = -1;
@@ -779,13 +3068,9 @@ void Game2048::addRandomTile() {
             return;
         }
         else {
-            vector<pair<int, int>> emptyCells;
-            for (int i = 0; i < BOARD_SIZE; i++)
-                for (int j = 0; j < BOARD_SIZE; j++)
-                    if (board[i][j] == 0) emptyCells.emplace_back(i, j);
-            if (!emptyCells.empty()) {
-                int idx = rand() % emptyCells.size();
-                board[emptyCells[idx].first][emptyCells[idx].second] = forcedSpawnNum;
+            int empty = board.countEmpty();
+            if (empty > 0) {
+                board.placeInEmpty(rand() % empty, forcedSpawnNum);
                 forcedSpawnNum = 0;
                 forcedSpawnX = -1;
                 forcedSpawnY = -1;
@@ -796,81 +3081,37 @@ void Game2048::addRandomTile() {
     }
 
     // 常规随机生成逻辑
-    vector<pair<int, int>> emptyCells;
-    for (int i = 0; i < BOARD_SIZE; i++)
-        for (int j = 0; j < BOARD_SIZE; j++)
-            if (board[i][j] == 0) emptyCells.emplace_back(i, j);
-    if (!emptyCells.empty()) {
-        int idx = rand() % emptyCells.size();
-        board[emptyCells[idx].first][emptyCells[idx].second] = (rand() % 10 == 0) ? 4 : 2;
+    int empty = board.countEmpty();
+    if (empty > 0) {
+        int idx = rand() % empty;
+        board.placeInEmpty(idx, (rand() % 10 == 0) ? 4 : 2);
     }
     spawnHint = "";
 }
 
-// 矩阵旋转
-void Game2048::rotateBoard() {
-    vector<vector<int>> rotated(BOARD_SIZE, vector<int>(BOARD_SIZE));
-    for (int i = 0; i < BOARD_SIZE; i++)
-        for (int j = 0; j < BOARD_SIZE; j++)
-            rotated[j][BOARD_SIZE - 1 - i] = board[i][j];
-    board = std::move(rotated);
-}
-
-// 行左移
-bool Game2048::moveRowLeft(vector<int>& row) {
-    vector<int> newRow(BOARD_SIZE, 0);
-    int idx = 0;
-    bool merged = false;
-    for (int num : row) {
-        if (num == 0) continue;
-        if (newRow[idx] == 0) {
-            newRow[idx] = num;
-        }
-        else if (newRow[idx] == num) {
-            newRow[idx] *= 2;
-            score += newRow[idx];
-            if (score > highScore) highScore = score;
-            idx++;
-            merged = true;
-        }
-        else {
-            idx++;
-            newRow[idx] = num;
-        }
-    }
-    if (row != newRow) {
-        row = std::move(newRow);
-        return true;
-    }
-    return merged;
+// 移动棋盘，合并得分计入当前分数
+bool Game2048::moveBoard(int direction) {
+    if (!board.move(direction, score)) return false;
+    if (score > highScore) highScore = score;
+    return true;
 }
 
 // 四个方向移动
-bool Game2048::moveLeft() { bool ok = false; for (auto& r : board) if (moveRowLeft(r)) ok = true; return ok; }
-bool Game2048::moveRight() { rotateBoard(); rotateBoard(); bool ok = moveLeft(); rotateBoard(); rotateBoard(); return ok; }
-bool Game2048::moveUp() { rotateBoard(); rotateBoard(); rotateBoard(); bool ok = moveLeft(); rotateBoard(); return ok; }
-bool Game2048::moveDown() { rotateBoard(); bool ok = moveLeft(); rotateBoard(); rotateBoard(); rotateBoard(); return ok; }
+bool Game2048::moveLeft() { return moveBoard(2); }
+bool Game2048::moveRight() { return moveBoard(3); }
+bool Game2048::moveUp() { return moveBoard(0); }
+bool Game2048::moveDown() { return moveBoard(1); }
 
 // 检查可移动
 bool Game2048::canMove() {
-    for (int i = 0; i < BOARD_SIZE; i++)
-        for (int j = 0; j < BOARD_SIZE; j++)
-            if (board[i][j] == 0) return true;
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            if (j < BOARD_SIZE - 1 && board[i][j] == board[i][j + 1]) return true;
-            if (i < BOARD_SIZE - 1 && board[i][j] == board[i + 1][j]) return true;
-        }
-    }
-    return false;
+    return board.canMove();
 }
 
-// 检查是否获胜
+// 检查是否获胜：首次出现目标方块时设置获胜标记并返回true
 bool Game2048::hasWon() {
-    if (haveWonFlag) return false;
+    if (haveWonFlag || !board.hasTile(TARGET)) return false;
     haveWonFlag = true;
-    for (auto& r : board) for (int num : r) if (num == TARGET) return true;
-    return false;
+    return true;
 }
 
 // 颜色码
@@ -988,104 +3229,73 @@ std::string Game2048::drawDownLargeHorizontalLine() {
     return line;
 }
 
-// 练习模式：保存当前状态到历史记录
-void Game2048::savePracticeState() {
-    if (practiceMode) {
-        practiceHistory.push_back(board);
-        practiceHistoryScores.push_back(score);
+// 撤销到上一个局面（普通模式和练习模式都可用）
+bool Game2048::undoMove() {
+    return history.undo(board, score, highScore, haveWonFlag);
+}
 
-        if (practiceHistory.size() > MAX_UNDO_STEPS) {
-            practiceHistory.erase(practiceHistory.begin());
-            practiceHistoryScores.erase(practiceHistoryScores.begin());
-        }
-    }
+// 重做被撤销的一步
+bool Game2048::redoMove() {
+    return history.redo(board, score, highScore, haveWonFlag);
 }
 
-// 练习模式下撤销
-bool Game2048::undoPractice() {
-    if (!practiceMode || practiceHistory.size() <= 1) {
-        return false;
+// 切换重做的分支，在底部提示当前分支
+void Game2048::switchRedoBranch() {
+    int branch = history.switchBranch();
+    moveCursor(termHeight - 1, 0);
+    if (branch == 0) {
+        cout << "\033[31m" << getString("no_branches") << "\033[0m" << flush;
     }
-
-    practiceHistory.pop_back();
-    practiceHistoryScores.pop_back();
-
-    board = practiceHistory.back();
-    score = practiceHistoryScores.back();
-
-    return true;
+    else {
+        cout << getString("redo_branch") << branch << "/" << history.branchCount() << flush;
+    }
+#ifdef _WIN32
+    Sleep(1000);
+#else
+    usleep(1000000);
+#endif
 }
 
 // 取消AI评估
 void Game2048::cancelAIAnalysis() {
-    if (aiEvaluating && aiFuture.valid()) {
-        aiCancelFlag = true;
-        if (aiFuture.wait_for(chrono::milliseconds(50)) == future_status::ready) {
-            try {
-                aiFuture.get();
-            }
-            catch (...) {
-                // 忽略异常
-            }
-        }
+    if (aiEvaluating) {
+        aiService.cancel();
         aiEvaluating = false;
     }
 }
 
-// 异步启动AI评估
+// 异步启动AI评估（提交给常驻分析服务，旧请求会被自动取代）
 void Game2048::startAsyncAIAnalysis() {
-    if (aiEvaluating) {
-        cancelAIAnalysis();
-    }
-
     aiEvaluating = true;
-    aiCancelFlag = false;
-
-    vector<vector<int>> currentBoard = board;
-
-    packaged_task<pair<int, vector<float>>()> task([this, currentBoard]() -> pair<int, vector<float>> {
-        AIEvaluator localEvaluator;
-        return localEvaluator.getBestMove(currentBoard);
-        });
-
-    aiFuture = task.get_future();
-
-    thread([this, task = std::move(task)]() mutable {
-        task();
-        }).detach();
-}
-
-// 检查AI评估是否完成并获取结果
-bool Game2048::checkAIAnalysisResult() {
-    if (!aiEvaluating || !aiFuture.valid()) {
-        return false;
-    }
-
-    auto status = aiFuture.wait_for(chrono::milliseconds(0));
-    if (status != future_status::ready) {
-        return false;
-    }
-
-    try {
-        auto result = aiFuture.get();
-        {
-            lock_guard<mutex> lock(aiMutex);
-            if (!aiCancelFlag) {
-                aiBestMove = result.first;
-                moveScores = result.second;
-            }
-        }
-        aiEvaluating = false;
-        return true;
-    }
-    catch (const future_error& e) {
-        aiEvaluating = false;
+    aiRequestId = board.hasBitboard() ? aiService.submit(board.bitboard()) : aiService.submit(board.toGrid());
+}
+
+// 检查AI评估是否完成并获取结果
+bool Game2048::checkAIAnalysisResult() {
+    if (!aiEvaluating) {
         return false;
     }
-    catch (...) {
-        aiEvaluating = false;
+
+    AIAnalysisService::Result result;
+    if (!aiService.poll(result) || result.requestId != aiRequestId) {
         return false;
     }
+
+    {
+        lock_guard<mutex> lock(aiMutex);
+        aiBestMove = result.bestMove;
+        moveScores = result.scores;
+        aiStats = result.stats;
+        aiPondered = result.pondered;
+    }
+    aiEvaluating = false;
+
+    if (!AI_OPTIONS.telemetryFile.empty()) {
+        if (!telemetryOut.is_open()) telemetryOut.open(AI_OPTIONS.telemetryFile, ios::app);
+        telemetryOut << searchStatsJson(board.toGrid(), result.stats, result.bestMove, result.pondered)
+                     << endl;
+    }
+    return true;
 }
 
 void Game2048::triggerAIAnalysis() {
@@ -1155,8 +3365,7 @@ void Game2048::buildFrameBuffer() {
     frameBuffer[lineIdx++] = oss.str();
 
     // 绘制分数栏
-    int maxNum = 0;
-    for (auto& r : board) for (int num : r) if (num > maxNum) maxNum = num;
+    int maxNum = board.maxTile();
     string scoreStr = getString("current_score") + to_string(score);
     string maxNumStr = getString("max_tile") + (maxNum > 0 ? to_string(maxNum) : "0");
     int scoreWidth = getChineseAwareWidth(scoreStr);
@@ -1245,6 +3454,32 @@ void Game2048::buildFrameBuffer() {
             if (!alive){
                 oss << "\033[1;31m" << getString("no_valid_move") << "\033[0m";
             }
+            else if ((aiAutoMode || DEBUG) && aiStats.book) {
+                oss << " [" << getString("opening_book") << "]";
+            }
+            else if ((aiAutoMode || DEBUG) && aiStats.nodes > 0) {
+                // 显示置换表命中率和搜索耗时，便于观察缓存跨步复用的效果
+                oss << " [";
+                if (aiService.getEngine() == AIEngine::MCTS) oss << "MCTS | ";
+                else oss << getString("cache_hit_rate") << " " << static_cast<int>(aiStats.cacheHitRate() * 100 + 0.5) << "% | ";
+                oss << static_cast<int>(aiStats.seconds * 1000 + 0.5) << "ms";
+                if (DEBUG) {
+                    // 节点数、速率、完成深度/最大深度和置换表占用
+                    auto compact = [](double value) {
+                        char buf[16];
+                        if (value >= 1e6) snprintf(buf, sizeof(buf), "%.1fM", value / 1e6);
+                        else if (value >= 1e3) snprintf(buf, sizeof(buf), "%.1fK", value / 1e3);
+                        else snprintf(buf, sizeof(buf), "%.0f", value);
+                        return string(buf);
+                    };
+                    oss << " | " << compact(static_cast<double>(aiStats.nodes)) << " " << getString("search_nodes")
+                        << " | " << compact(aiStats.nodesPerSecond()) << "/s"
+                        << " | " << getString("search_depth") << " " << aiStats.completedDepth << "/" << aiStats.maxdepth
+                        << " | " << getString("tt_fill") << " " << static_cast<int>(aiStats.ttFill * 100 + 0.5) << "%";
+                }
+                if (aiPondered) oss << " | " << getString("pondered");
+                oss << "]";
+            }
         }
 
         string aiStr = oss.str();
@@ -1269,7 +3504,7 @@ void Game2048::buildFrameBuffer() {
         for (int cellLine = 0; cellLine < CELL_HEIGHT; cellLine++) {
             oss.str(""); oss << "│";
             for (int col = 0; col < BOARD_SIZE; col++) {
-                int val = board[row][col];
+                int val = board.get(row, col);
                 oss << getColor(val);
                 string line = drawLargeCellLine(val, cellLine);
                 for (auto chr : line) {
@@ -1356,20 +3591,19 @@ void Game2048::resetFrameBuffer() {
 
 // 重新开始游戏
 void Game2048::restartGame() {
-    board.assign(BOARD_SIZE, vector<int>(BOARD_SIZE, 0));
-    prevBoard.assign(BOARD_SIZE, vector<int>(BOARD_SIZE, -1));
+    board = GameBoard();
+    prevBoard = GameBoard();
     score = 0;
     prevScore = -1;
     haveWonFlag = false;
     practiceMode = false;
-    practiceHistory.clear();
-    practiceHistoryScores.clear();
     forcedSpawnNum = 0;
     forcedSpawnX = -1;
     forcedSpawnY = -1;
     spawnHint = "";
     addRandomTile();
     addRandomTile();
+    history.reset(board, score, highScore, haveWonFlag);
 
     cancelAIAnalysis();
     moveScores = vector<float>(4, 0.0f);
@@ -1381,7 +3615,7 @@ void Game2048::restartGame() {
 
 // 练习模式：进入练习模式
 void Game2048::enterPracticeMode() {
-    vector<vector<int>> savedBoard = board;
+    GameBoard savedBoard = board;
     int savedScore = score;
     int savedForcedNum = forcedSpawnNum;
     int savedForcedX = forcedSpawnX;
@@ -1461,18 +3695,14 @@ void Game2048::enterPracticeMode() {
         cout << "\n" << getString("press_any_key") << flush;
     }
     else {
-        board = newBoard;
+        board = GameBoard::fromGrid(newBoard);
         score = 0;
         practiceMode = true;
-        practiceHistory.clear();
-        practiceHistoryScores.clear();
         forcedSpawnNum = 0;
         forcedSpawnX = -1;
         forcedSpawnY = -1;
         spawnHint = "";
-
-        practiceHistory.push_back(board);
-        practiceHistoryScores.push_back(score);
+        history.reset(board, score, highScore, haveWonFlag);
 
         cout << "\n" << getString("entered_practice_mode") << "\n";
         cout << getString("practice_commands") << "\n";
@@ -1505,7 +3735,7 @@ void Game2048::handleForcedSpawnInput() {
         valid = false;
         spawnHint = "\033[31m" + getString("spawn_error_num") + "\033[0m";
     }
-    else if (x < 1 || x > 4 || y < 1 || y > 4) {
+    else if (x < 1 || x > BOARD_SIZE || y < 1 || y > BOARD_SIZE) {
         valid = false;
         spawnHint = "\033[31m" + getString("spawn_error_pos") + "\033[0m";
     }
@@ -1546,6 +3776,7 @@ void Game2048::showhelp() {
     string controlStr = getString("quit_restart");
     string saveLoadStr = getString("save_load");
     string practiceStr = getString("practice_controls");
+    string historyStr = getString("history_controls");
     string aiStr = getString("ai_controls");
 
     int languageWidth = getChineseAwareWidth(languageStr);
@@ -1553,6 +3784,7 @@ void Game2048::showhelp() {
     int controlWidth = getChineseAwareWidth(controlStr);
     int saveLoadWidth = getChineseAwareWidth(saveLoadStr);
     int practiceWidth = getChineseAwareWidth(practiceStr);
+    int historyWidth = getChineseAwareWidth(historyStr);
     int aiWidth = getChineseAwareWidth(aiStr);
 
     int languagePadding = (totalWidth - 2 - languageWidth) / 2;
@@ -1560,6 +3792,7 @@ void Game2048::showhelp() {
     int controlPadding = (totalWidth - 2 - controlWidth) / 2;
     int saveLoadPadding = (totalWidth - 2 - saveLoadWidth) / 2;
     int practicePadding = (totalWidth - 2 - practiceWidth) / 2;
+    int historyPadding = (totalWidth - 2 - historyWidth) / 2;
     int aiPadding = (totalWidth - 2 - aiWidth) / 2;
 
     oss << "│" << makestring(languagePadding, ' ') << languageStr << makestring(totalWidth - 2 - languageWidth - languagePadding, ' ') << "│\n";
@@ -1567,6 +3800,7 @@ void Game2048::showhelp() {
     oss << "│" << makestring(controlPadding, ' ') << controlStr << makestring(totalWidth - 2 - controlWidth - controlPadding, ' ') << "│\n";
     oss << "│" << makestring(saveLoadPadding, ' ') << saveLoadStr << makestring(totalWidth - 2 - saveLoadWidth - saveLoadPadding, ' ') << "│\n";
     oss << "│" << makestring(practicePadding, ' ') << practiceStr << makestring(totalWidth - 2 - practiceWidth - practicePadding, ' ') << "│\n";
+    oss << "│" << makestring(historyPadding, ' ') << historyStr << makestring(totalWidth - 2 - historyWidth - historyPadding, ' ') << "│\n";
     oss << "│" << makestring(aiPadding, ' ') << aiStr << makestring(totalWidth - 2 - aiWidth - aiPadding, ' ') << "│\n";
     oss << "└" << makestring(totalWidth - 2, "─") << "┘\n\n";
     cout << oss.str() << flush;
@@ -1606,9 +3840,9 @@ bool Game2048::saveGame() {
         return false;
     }
     saveFile << score << "\n";
-    for (auto& r : board) {
+    for (int i = 0; i < BOARD_SIZE; i++) {
         for (int j = 0; j < BOARD_SIZE; j++) {
-            saveFile << r[j];
+            saveFile << board.get(i, j);
             if (j < BOARD_SIZE - 1) saveFile << " ";
         }
         saveFile << "\n";
@@ -1680,17 +3914,16 @@ bool Game2048::loadGame() {
         resetFrameBuffer();
         return false;
     }
-    board = std::move(savedBoard);
+    board = GameBoard::fromGrid(savedBoard);
     score = savedScore;
     haveWonFlag = false;
     practiceMode = false;
-    practiceHistory.clear();
-    practiceHistoryScores.clear();
+    history.reset(board, score, highScore, haveWonFlag);
     forcedSpawnNum = 0;
     forcedSpawnX = -1;
     forcedSpawnY = -1;
     spawnHint = "";
-    prevBoard.assign(BOARD_SIZE, vector<int>(BOARD_SIZE, -1));
+    prevBoard = GameBoard();
     prevScore = -1;
 
     cancelAIAnalysis();
@@ -1711,7 +3944,6 @@ bool Game2048::loadGame() {
 // 游戏主循环
 void Game2048::play() {
     bool gameOver = false;
-    bool won = false;
     int lastTermW = termWidth;
     int lastTermH = termHeight;
 
@@ -1721,7 +3953,8 @@ void Game2048::play() {
     triggerAIAnalysis();
     displayBoard();
 
-    while (!gameOver) {
+    while (!gameOver || offerUndoAfterGameOver()) {
+        gameOver = false;
         updateTerminalSize();
         if (termWidth != lastTermW || termHeight != lastTermH) {
             resetFrameBuffer();
@@ -1777,20 +4010,14 @@ void Game2048::play() {
 
                 if (validMove) {
                     addRandomTile();
-                    if (practiceMode) {
-                        savePracticeState();
-                    }
-
+                    hasWon();   // 先更新获胜标记，再连同局面记入历史
+                    history.record(board, score, highScore, haveWonFlag);
 
                     triggerAIAnalysis();
                     displayBoard();
                     prevBoard = board;
                     prevScore = score;
 
-                    if (hasWon() && !won) {
-                        won = true;
-                        displayBoard();
-                    }
                     if (!canMove()) {
                         gameOver = true;
                         aiAutoMode = false;
@@ -1811,11 +4038,17 @@ void Game2048::play() {
             input = keyboard.getKey();
         }
         else {
+            // 分析进行中时等待结果而不是固定休眠，预搜索命中的结果可以立刻显示
+            if (aiEvaluating) {
+                aiService.waitResult(10);
+            }
+            else {
 #ifdef _WIN32
-            Sleep(10);
+                Sleep(10);
 #else
-            usleep(10000);
+                usleep(10000);
 #endif
+            }
             continue;
         }
 
@@ -1889,24 +4122,18 @@ void Game2048::play() {
                 displayBoard();
                 continue;
             case 'z':
-                if (practiceMode) {
-                    if (undoPractice()) {
-                        displayBoard();
-#ifdef _WIN32
-                        Sleep(500);
-#else
-                        usleep(500000);
-#endif
-                    }
-                    else {
-#ifdef _WIN32
-                        Sleep(500);
-#else
-                        usleep(500000);
-#endif
-                    }
+            case 'y':
+                if (tolower(input) == 'z' ? undoMove() : redoMove()) {
+                    cancelAIAnalysis();
+                    triggerAIAnalysis();
+                    displayBoard();
                 }
                 continue;
+            case 'b':
+                switchRedoBranch();
+                resetFrameBuffer();
+                displayBoard();
+                continue;
             case 'k':
                 if (practiceMode) {
                     handleForcedSpawnInput();
@@ -1937,6 +4164,12 @@ void Game2048::play() {
                 }
                 displayBoard();
                 continue;
+            case 'c':
+                if (BOARD_SIZE != 4) continue;  // 其他尺寸只有期望最大搜索
+                aiService.setEngine(aiService.getEngine() == AIEngine::MCTS ? AIEngine::Expectimax : AIEngine::MCTS);
+                triggerAIAnalysis();
+                displayBoard();
+                continue;
             case 'e':
                 switchLanguage();
                 continue;
@@ -1949,36 +4182,994 @@ void Game2048::play() {
                 cancelAIAnalysis();
             }
 
-            if (practiceMode) {
-                savePracticeState();
-            }
-
             addRandomTile();
+            hasWon();
+            history.record(board, score, highScore, haveWonFlag);
             triggerAIAnalysis();
             displayBoard();
             prevBoard = board;
             prevScore = score;
 
-            if (hasWon() && !won) {
-                won = true;
-                displayBoard();
-            }
             if (!canMove()) gameOver = true;
         }
     }
+}
 
+// 显示结算信息；按Z撤销输掉的那一步后返回true，游戏继续
+bool Game2048::offerUndoAfterGameOver() {
     moveCursor(termHeight, 0);
     cout << "\n══════════════════════════════════════════════════════\n";
     cout << "                   " << getString("game_over") << "                         \n";
     cout << "                   " << getString("final_score") << score << "          \n";
     cout << "                   " << getString("high_score") << highScore << "      \n";
-    if (won) cout << "              " << getString("congratulations") << "                    \n";
+    if (haveWonFlag) cout << "              " << getString("congratulations") << "                    \n";
     else cout << "              " << getString("no_moves_left") << "                 \n";
     cout << "══════════════════════════════════════════════════════\n";
+    cout << getString("game_over_undo") << flush;
+
+    char input = keyboard.getKey();
+#ifdef _WIN32
+    if (input == '\340' || input == 0x00) keyboard.getKey();
+#else
+    if (input == '\033') {
+        keyboard.getKey();
+        keyboard.getKey();
+    }
+#endif
+    if (tolower(input) != 'z' || !undoMove()) return false;
+
+    cancelAIAnalysis();
+    clearScreen();
+    resetFrameBuffer();
+    triggerAIAnalysis();
+    displayBoard();
+    return true;
+}
+
+// ==================== 无界面工具 ====================
+
+// 在随机空位生成新数字（90%为2，10%为4）
+uint64_t spawnRandomTile(uint64_t board, mt19937_64& rng) {
+    int empty = AIEvaluator::countEmpty(board);
+    if (board == 0) empty = 16; // countEmpty对空棋盘溢出为0
+    if (empty == 0) return board;
+    int target = static_cast<int>(rng() % empty);
+    uint64_t tile = (rng() % 10 == 0) ? 2 : 1;
+    for (int shift = 0; shift < 64; shift += 4) {
+        if (((board >> shift) & 0xf) == 0) {
+            if (target == 0) return board | (tile << shift);
+            target--;
+        }
+    }
+    return board;
+}
+
+// 用贪心策略快速对局，采样出现过的局面作为测试语料
+vector<uint64_t> generateBoardCorpus(size_t count, uint64_t seed, int minDistinct) {
+    mt19937_64 rng(seed);
+    vector<uint64_t> corpus;
+
+    while (corpus.size() < count) {
+        uint64_t board = spawnRandomTile(spawnRandomTile(0, rng), rng);
+        while (corpus.size() < count) {
+            int bestMove = -1;
+            float bestScore = 0.0f;
+            for (int move = 0; move < 4; move++) {
+                uint64_t newboard = AIEvaluator::executeMove(move, board);
+                if (newboard == board) continue;
+                float score = AIEvaluator::scoreHeurBoard(newboard);
+                if (bestMove < 0 || score > bestScore || rng() % 10 == 0) {
+                    bestMove = move;
+                    bestScore = score;
+                }
+            }
+            if (bestMove < 0) break;
+
+            board = spawnRandomTile(AIEvaluator::executeMove(bestMove, board), rng);
+            if (AIEvaluator::countDistinctTiles(board) >= minDistinct && rng() % 8 == 0) {
+                corpus.push_back(board);
+            }
+        }
+    }
+    return corpus;
+}
+
+// 并行搜索基准：比较不同线程数下的节点速率与最佳移动一致性
+void runSearchBenchmark() {
+    vector<uint64_t> corpus = generateBoardCorpus(12, 2048, 8);
+    unsigned maxThreads = AI_OPTIONS.threads > 0 ? AI_OPTIONS.threads : thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 1;
+
+    vector<unsigned> threadCounts;
+    for (unsigned t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    vector<int> serialMoves;
+    double serialRate = 0.0;
+
+    cout << "boards: " << corpus.size() << "\n";
+    cout << setw(8) << "threads" << setw(16) << "nodes" << setw(12) << "seconds"
+         << setw(16) << "nodes/sec" << setw(10) << "speedup" << setw(12) << "same move" << "\n";
+
+    for (unsigned threads : threadCounts) {
+        unique_ptr<WorkStealingPool> pool(threads > 1 ? new WorkStealingPool(threads - 1) : nullptr);
+        AIEvaluator evaluator(pool.get());
+
+        unsigned long long nodes = 0;
+        double seconds = 0.0;
+        int same = 0;
+        for (size_t i = 0; i < corpus.size(); i++) {
+            int move = evaluator.getBestMove(corpus[i]).first;
+            nodes += evaluator.getLastStats().nodes;
+            seconds += evaluator.getLastStats().seconds;
+            if (threads == 1) serialMoves.push_back(move);
+            if (move == serialMoves[i]) same++;
+        }
+
+        double rate = seconds > 0.0 ? nodes / seconds : 0.0;
+        if (threads == 1) serialRate = rate;
+        cout << setw(8) << threads << setw(16) << nodes << setw(12) << fixed << setprecision(3) << seconds
+             << setw(16) << setprecision(0) << rate << setw(10) << setprecision(2)
+             << (serialRate > 0.0 ? rate / serialRate : 0.0)
+             << setw(8) << same << "/" << corpus.size() << "\n";
+    }
+
+    // 内核对比：在残局局面上串行搜索，各配置节点数一致，只比较速度
+    vector<uint64_t> lateCorpus = generateBoardCorpus(12, 4096, 10);
+    cout << "\nlate-game boards: " << lateCorpus.size() << "\n";
+    cout << setw(8) << "kernel" << setw(10) << "leaves" << setw(16) << "nodes" << setw(12) << "seconds"
+         << setw(16) << "nodes/sec" << setw(10) << "speedup" << "\n";
+    bool savedLeafBatch = AI_OPTIONS.leafBatch;
+    double baseKernelRate = 0.0;
+    for (bool simd : { false, true }) {
+        string kernel = AIEvaluator::selectSimdKernels(simd);
+        if (simd && kernel == "scalar") {
+            cout << "(no SIMD kernel available on this CPU)\n";
+            break;
+        }
+        for (bool batch : { false, true }) {
+            AI_OPTIONS.leafBatch = batch;
+            AIEvaluator evaluator;
+
+            unsigned long long nodes = 0;
+            double seconds = 0.0;
+            for (uint64_t board : lateCorpus) {
+                evaluator.getBestMove(board);
+                nodes += evaluator.getLastStats().nodes;
+                seconds += evaluator.getLastStats().seconds;
+            }
+
+            double rate = seconds > 0.0 ? nodes / seconds : 0.0;
+            if (baseKernelRate == 0.0) baseKernelRate = rate;
+            cout << setw(8) << kernel << setw(10) << (batch ? "batched" : "single") << setw(16) << nodes
+                 << setw(12) << fixed << setprecision(3) << seconds
+                 << setw(16) << setprecision(0) << rate << setw(10) << setprecision(2)
+                 << (baseKernelRate > 0.0 ? rate / baseKernelRate : 0.0) << "\n";
+        }
+    }
+    AI_OPTIONS.leafBatch = savedLeafBatch;
+    AIEvaluator::selectSimdKernels(AI_OPTIONS.simd);
+
+    if (AI_OPTIONS.approxMass > 0.0f) {
+        runApproximationReport(corpus);
+    }
+}
+
+// 近似搜索误差报告：同一批局面分别做精确和近似搜索，
+// 统计各方向得分的平均相对误差、最佳着法一致率，以及按精确估值计算的选择损失
+void runApproximationReport(const vector<uint64_t>& corpus) {
+    float approxMass = AI_OPTIONS.approxMass;
+    unsigned long long exactNodes = 0, approxNodes = 0;
+    double exactSeconds = 0.0, approxSeconds = 0.0;
+    double errorSum = 0.0, lossSum = 0.0;
+    int compared = 0, same = 0;
+
+    for (uint64_t board : corpus) {
+        AI_OPTIONS.approxMass = 0.0f;
+        AIEvaluator exact;
+        pair<int, vector<float>> ref = exact.getBestMove(board);
+        exactNodes += exact.getLastStats().nodes;
+        exactSeconds += exact.getLastStats().seconds;
+
+        AI_OPTIONS.approxMass = approxMass;
+        AIEvaluator approx;
+        pair<int, vector<float>> res = approx.getBestMove(board);
+        approxNodes += approx.getLastStats().nodes;
+        approxSeconds += approx.getLastStats().seconds;
+
+        float best = ref.first >= 0 ? ref.second[ref.first] : 0.0f;
+        if (best <= 0.0f || res.first < 0) continue;
+
+        double error = 0.0;
+        int moves = 0;
+        for (int move = 0; move < 4; move++) {
+            if (ref.second[move] > 0.0f) {
+                error += fabs(res.second[move] - ref.second[move]) / ref.second[move];
+                moves++;
+            }
+        }
+        errorSum += error / moves;
+        lossSum += (best - ref.second[res.first]) / best;
+        if (res.first == ref.first) same++;
+        compared++;
+    }
+
+    cout << "\napproximation (mass < " << approxMass << ", " << AI_OPTIONS.approxCells << " cells) vs exact\n";
+    cout << setw(10) << "search" << setw(16) << "nodes" << setw(12) << "seconds" << setw(10) << "speedup" << "\n";
+    cout << setw(10) << "exact" << setw(16) << exactNodes << setw(12) << fixed << setprecision(3) << exactSeconds
+         << setw(10) << setprecision(2) << 1.0 << "\n";
+    cout << setw(10) << "approx" << setw(16) << approxNodes << setw(12) << setprecision(3) << approxSeconds
+         << setw(10) << setprecision(2) << (approxSeconds > 0.0 ? exactSeconds / approxSeconds : 0.0) << "\n";
+    if (compared > 0) {
+        cout << "mean score error: " << setprecision(3) << errorSum / compared * 100 << "%, "
+             << "same best move: " << same << "/" << compared << ", "
+             << "mean loss of chosen move: " << setprecision(4) << lossSum / compared * 100 << "%\n";
+    }
+}
+
+// 局面中最大方块的指数
+static int maxTileExponent(uint64_t board) {
+    int maxTile = 0;
+    for (; board; board >>= 4) maxTile = max(maxTile, static_cast<int>(board & 0xf));
+    return maxTile;
+}
+
+// TD自对弈训练：每个线程独立对局，贪心选择“合并得分 + 后继估值”最高的移动，
+// 整局结束后从最后一步向前做afterstate的TD更新。各线程不加锁地共享同一份权重（Hogwild方式），
+// 权重按原子变量宽松读写，并发时偶尔丢失的更新对训练没有可见影响
+void runTdTraining(const TrainOptions& options) {
+    NTupleNetwork net;
+    if (!AI_OPTIONS.ntupleFile.empty()) {
+        // 从已有权重继续训练：复制到匿名内存，保存检查点时不必重新映射
+        NTupleNetwork initial;
+        if (!initial.load(AI_OPTIONS.ntupleFile)) {
+            cerr << "Failed to load n-tuple network: " << AI_OPTIONS.ntupleFile << endl;
+            return;
+        }
+        vector<vector<int>> patterns;
+        for (const auto& tuple : initial.getTuples()) patterns.push_back(tuple.cells);
+        if (!net.create(patterns)) return;
+        for (size_t i = 0; i < patterns.size(); i++) {
+            const auto& from = initial.getTuples()[i];
+            for (size_t w = 0; w < from.size; w++) {
+                net.getTuples()[i].weights[w].store(from.weights[w].load(memory_order_relaxed), memory_order_relaxed);
+            }
+        }
+    }
+    else if (!net.create(NTupleNetwork::defaultPatterns())) {
+        cerr << "Failed to allocate n-tuple network" << endl;
+        return;
+    }
+
+    unsigned threads = configuredThreadCount();
+    float step = options.alpha / net.featureCount();
+    float lambda = options.lambda;
+
+    atomic<unsigned long long> started(0), finished(0), totalScore(0), totalMoves(0), reached2048(0), reached8192(0);
+
+    auto worker = [&](unsigned id) {
+        mt19937_64 rng(options.seed + id * 0x9E3779B97F4A7C15ULL);
+        vector<uint64_t> afterstates;
+        vector<float> rewards;
+
+        while (started.fetch_add(1) < options.games) {
+            afterstates.clear();
+            rewards.clear();
+            uint64_t board = spawnRandomTile(spawnRandomTile(0, rng), rng);
+            unsigned long long score = 0;
+
+            while (true) {
+                int bestMove = -1;
+                float bestValue = 0.0f, bestReward = 0.0f;
+                uint64_t bestAfter = 0;
+                for (int move = 0; move < 4; move++) {
+                    uint64_t after = AIEvaluator::executeMove(move, board);
+                    if (after == board) continue;
+                    float reward = AIEvaluator::moveReward(board, after);
+                    float value = reward + net.evaluate(after);
+                    if (bestMove < 0 || value > bestValue) {
+                        bestMove = move;
+                        bestValue = value;
+                        bestReward = reward;
+                        bestAfter = after;
+                    }
+                }
+                if (bestMove < 0) break;
+
+                afterstates.push_back(bestAfter);
+                rewards.push_back(bestReward);
+                score += static_cast<unsigned long long>(bestReward);
+                board = spawnRandomTile(bestAfter, rng);
+            }
+
+            // 终局前最后一个afterstate的目标值为0；其余目标为下一步得分加上λ-回报与下一估值的混合
+            float target = 0.0f;
+            for (size_t i = afterstates.size(); i-- > 0;) {
+                if (i + 1 < afterstates.size()) {
+                    float nextValue = net.evaluate(afterstates[i + 1]);
+                    target = rewards[i + 1] + (1.0f - lambda) * nextValue + lambda * target;
+                }
+                net.update(afterstates[i], step * (target - net.evaluate(afterstates[i])));
+            }
+
+            int maxTile = maxTileExponent(board);
+            totalScore += score;
+            totalMoves += afterstates.size();
+            if (maxTile >= 11) reached2048++;
+            if (maxTile >= 13) reached8192++;
+            finished++;
+        }
+    };
+
+    cout << "training " << options.games << " games on " << threads << " threads, alpha " << options.alpha
+         << ", lambda " << lambda << ", " << net.getTuples().size() << " tuples -> " << options.outFile << "\n";
+    cout << setw(12) << "games" << setw(12) << "avg score" << setw(10) << "2048%" << setw(10) << "8192%"
+         << setw(12) << "games/sec" << setw(14) << "moves/sec" << "\n";
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned id = 0; id < threads; id++) workers.emplace_back(worker, id);
+
+    // 主线程按检查点间隔汇报本区间的统计并保存权重，保存时训练线程继续运行，save()写出的是权重的一份副本
+    unsigned long long lastGames = 0, lastScore = 0, lastMoves = 0, last2048 = 0, last8192 = 0;
+    auto lastTime = start;
+    unsigned long long interval = max(1ULL, options.checkpointGames);
+    while (lastGames < options.games) {
+        unsigned long long games = finished.load();
+        if (games < min(options.games, lastGames + interval)) {
+            this_thread::sleep_for(chrono::milliseconds(20));
+            continue;
+        }
+
+        auto now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - lastTime).count();
+        unsigned long long score = totalScore.load(), moves = totalMoves.load();
+        unsigned long long r2048 = reached2048.load(), r8192 = reached8192.load();
+        double count = static_cast<double>(games - lastGames);
+        cout << setw(12) << games << setw(12) << fixed << setprecision(0) << (score - lastScore) / count
+             << setw(10) << setprecision(2) << (r2048 - last2048) * 100.0 / count
+             << setw(10) << (r8192 - last8192) * 100.0 / count
+             << setw(12) << setprecision(1) << (seconds > 0.0 ? count / seconds : 0.0)
+             << setw(14) << setprecision(0) << (seconds > 0.0 ? (moves - lastMoves) / seconds : 0.0) << endl;
+        if (!net.save(options.outFile)) cerr << "Failed to write " << options.outFile << endl;
+
+        lastGames = games;
+        lastScore = score;
+        lastMoves = moves;
+        last2048 = r2048;
+        last8192 = r8192;
+        lastTime = now;
+    }
+
+    for (auto& t : workers) t.join();
+    cout << "total " << fixed << setprecision(1)
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+}
+
+template <typename Engine>
+static SelfPlayResult playSelfPlayGameWith(Engine& engine, uint64_t seed, int maxMoves) {
+    mt19937_64 rng(seed);
+    uint64_t board = spawnRandomTile(spawnRandomTile(0, rng), rng);
+    SelfPlayResult result;
+
+    while (maxMoves <= 0 || result.moves < maxMoves) {
+        int move = engine.getBestMove(board).first;
+        result.nodes += engine.getLastStats().nodes;
+        result.seconds += engine.getLastStats().seconds;
+        if (move < 0) break;
+
+        uint64_t after = AIEvaluator::executeMove(move, board);
+        if (after == board) break;
+        result.score += static_cast<unsigned long long>(AIEvaluator::moveReward(board, after));
+        result.moves++;
+        board = spawnRandomTile(after, rng);
+    }
+    result.maxTile = maxTileExponent(board);
+    return result;
+}
+
+SelfPlayResult playSelfPlayGame(AIEvaluator& evaluator, uint64_t seed, int maxMoves) {
+    return playSelfPlayGameWith(evaluator, seed, maxMoves);
+}
+
+SelfPlayResult playSelfPlayGame(MCTSEngine& engine, uint64_t seed, int maxMoves) {
+    return playSelfPlayGameWith(engine, seed, maxMoves);
+}
+
+// 设置了--tt-file时，无界面对弈的所有评估器共用一张置换表：开始时加载快照，结束时保存。
+// 未设置时返回空指针，每个评估器使用自己的表，结果与线程数和调度无关
+static shared_ptr<TranspositionTable> openSharedTable() {
+    if (AI_OPTIONS.ttFile.empty()) return nullptr;
+    shared_ptr<TranspositionTable> table = make_shared<TranspositionTable>(AI_OPTIONS.ttMegabytes);
+    AIEvaluator owner(nullptr, table);
+    if (owner.loadTableSnapshot(AI_OPTIONS.ttFile)) cout << "loaded transposition table snapshot " << AI_OPTIONS.ttFile << endl;
+    return table;
+}
+
+static void saveSharedTable(const shared_ptr<TranspositionTable>& table) {
+    if (!table) return;
+    AIEvaluator owner(nullptr, table);
+    if (!owner.saveTableSnapshot(AI_OPTIONS.ttFile)) cerr << "Failed to save transposition table snapshot: " << AI_OPTIONS.ttFile << endl;
+}
+
+// 调优的线性权重：在对数空间搜索，保证始终为正；两个幂次保持不变
+static float HeuristicWeights::* const TUNED_WEIGHTS[] = {
+    &HeuristicWeights::lostPenalty,
+    &HeuristicWeights::monotonicityWeight,
+    &HeuristicWeights::sumWeight,
+    &HeuristicWeights::mergesWeight,
+    &HeuristicWeights::emptyWeight
+};
+
+// 对角协方差的CMA-ES（sep-CMA-ES）：维数小、评估噪声大，不需要完整协方差矩阵。
+// 每代的所有候选使用同一组对局种子，候选之间的比较不受发牌运气影响
+void runWeightTuning(const TuneOptions& options) {
+    const int n = sizeof(TUNED_WEIGHTS) / sizeof(TUNED_WEIGHTS[0]);
+    int lambda = options.population > 0 ? options.population : 4 + static_cast<int>(3 * log(n));
+    lambda = max(lambda, 2);
+    int mu = lambda / 2;
+
+    vector<double> recombination(mu);
+    for (int i = 0; i < mu; i++) recombination[i] = log(mu + 0.5) - log(i + 1.0);
+    double total = accumulate(recombination.begin(), recombination.end(), 0.0);
+    double squares = 0.0;
+    for (double& w : recombination) {
+        w /= total;
+        squares += w * w;
+    }
+    double mueff = 1.0 / squares;
+
+    double cs = (mueff + 2) / (n + mueff + 5);
+    double ds = 1 + 2 * max(0.0, sqrt((mueff - 1) / (n + 1)) - 1) + cs;
+    double cc = (4 + mueff / n) / (n + 4 + 2 * mueff / n);
+    double c1 = 2 / ((n + 1.3) * (n + 1.3) + mueff) * (n + 2) / 3;
+    double cmu = min(1 - c1, 2 * (mueff - 2 + 1 / mueff) / ((n + 2) * (n + 2) + mueff) * (n + 2) / 3);
+    double chiN = sqrt(n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+    HeuristicWeights base = AI_OPTIONS.weights;
+    vector<double> mean(n), diag(n, 1.0), ps(n, 0.0), pc(n, 0.0);
+    for (int d = 0; d < n; d++) mean[d] = log(max(1e-6f, base.*TUNED_WEIGHTS[d]));
+    double sigma = options.sigma;
+
+    auto toWeights = [&](const vector<double>& x) {
+        HeuristicWeights w = base;
+        for (int d = 0; d < n; d++) w.*TUNED_WEIGHTS[d] = static_cast<float>(exp(x[d]));
+        return w;
+    };
+
+    // 调优时默认用1层搜索，整局对弈足够快
+    int savedDepth = AI_OPTIONS.searchDepth;
+    if (AI_OPTIONS.searchDepth <= 0) AI_OPTIONS.searchDepth = 1;
+    unsigned threads = configuredThreadCount();
+    if (!AI_OPTIONS.ttFile.empty()) {
+        cerr << "--tt-file is not used while tuning: a snapshot only matches the weights it was written with" << endl;
+    }
+    if (!AI_OPTIONS.ntupleFile.empty()) {
+        cerr << "--ntuple is not used while tuning: candidates are scored with the heuristic leaf evaluation" << endl;
+    }
+
+    cout << "tuning " << n << " weights, population " << lambda << ", " << options.gamesPerCandidate
+         << " games per candidate at depth " << AI_OPTIONS.searchDepth << " on " << threads << " threads\n";
+    cout << setw(6) << "gen" << setw(12) << "best" << setw(12) << "mean" << setw(10) << "sigma" << "  weights of best\n";
+
+    mt19937_64 rng(options.seed);
+    normal_distribution<double> normal;
+    HeuristicWeights bestWeights = base;
+    double bestFitness = -1.0;
+
+    for (int gen = 0; gen < options.generations; gen++) {
+        vector<vector<double>> steps(lambda, vector<double>(n));
+        vector<HeuristicWeights> candidates(lambda);
+        for (int k = 0; k < lambda; k++) {
+            vector<double> x(n);
+            for (int d = 0; d < n; d++) {
+                steps[k][d] = sqrt(diag[d]) * normal(rng);
+                x[d] = mean[d] + sigma * steps[k][d];
+            }
+            candidates[k] = toWeights(x);
+        }
+
+        // 候选之间并行，每个线程为它的候选建立独立的评估器
+        vector<double> fitness(lambda, 0.0);
+        atomic<int> next(0);
+        uint64_t genSeed = options.seed + static_cast<uint64_t>(gen + 1) * 1000003ULL;
+        vector<thread> workers;
+        for (unsigned t = 0; t < min<unsigned>(threads, lambda); t++) {
+            workers.emplace_back([&]() {
+                for (int k = next++; k < lambda; k = next++) {
+                    // 叶子用n-tuple网络估值时启发式权重不起作用，调优的评估器总是用启发式
+                    AIEvaluator evaluator;
+                    evaluator.setNetwork(nullptr);
+                    evaluator.setHeuristicWeights(candidates[k]);
+                    unsigned long long sum = 0;
+                    for (int g = 0; g < options.gamesPerCandidate; g++) {
+                        sum += playSelfPlayGame(evaluator, genSeed + g).score;
+                    }
+                    fitness[k] = static_cast<double>(sum) / max(1, options.gamesPerCandidate);
+                }
+            });
+        }
+        for (auto& t : workers) t.join();
+
+        vector<int> order(lambda);
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&fitness](int a, int b) { return fitness[a] > fitness[b]; });
+        if (fitness[order[0]] > bestFitness) {
+            bestFitness = fitness[order[0]];
+            bestWeights = candidates[order[0]];
+        }
+
+        // 均值、进化路径、对角协方差和步长更新
+        vector<double> yw(n, 0.0);
+        for (int i = 0; i < mu; i++) {
+            for (int d = 0; d < n; d++) yw[d] += recombination[i] * steps[order[i]][d];
+        }
+        double psNorm = 0.0;
+        for (int d = 0; d < n; d++) {
+            mean[d] += sigma * yw[d];
+            ps[d] = (1 - cs) * ps[d] + sqrt(cs * (2 - cs) * mueff) * yw[d] / sqrt(diag[d]);
+            psNorm += ps[d] * ps[d];
+        }
+        psNorm = sqrt(psNorm);
+        bool hsig = psNorm / sqrt(1 - pow(1 - cs, 2.0 * (gen + 1))) < (1.4 + 2.0 / (n + 1)) * chiN;
+        for (int d = 0; d < n; d++) {
+            pc[d] = (1 - cc) * pc[d] + (hsig ? sqrt(cc * (2 - cc) * mueff) : 0.0) * yw[d];
+            double rankMu = 0.0;
+            for (int i = 0; i < mu; i++) rankMu += recombination[i] * steps[order[i]][d] * steps[order[i]][d];
+            diag[d] = (1 - c1 - cmu) * diag[d] + c1 * (pc[d] * pc[d] + (hsig ? 0.0 : cc * (2 - cc) * diag[d])) + cmu * rankMu;
+        }
+        sigma *= exp((cs / ds) * (psNorm / chiN - 1));
+
+        double meanFitness = accumulate(fitness.begin(), fitness.end(), 0.0) / lambda;
+        const HeuristicWeights& genBest = candidates[order[0]];
+        cout << setw(6) << gen + 1 << setw(12) << fixed << setprecision(0) << fitness[order[0]]
+             << setw(12) << meanFitness << setw(10) << setprecision(3) << sigma << " ";
+        for (auto member : TUNED_WEIGHTS) cout << " " << setprecision(1) << genBest.*member;
+        cout << endl;
+    }
+
+    AI_OPTIONS.searchDepth = savedDepth;
+    cout << "best (" << fixed << setprecision(0) << bestFitness << "):\n" << bestWeights.toString();
+    if (!bestWeights.save(options.outFile)) cerr << "Failed to write " << options.outFile << endl;
+}
+
+// 无界面自对弈基准：每个线程用串行评估器独立下完整局，第i局使用种子seed + i，
+// 结果与线程数和调度无关
+void runSelfPlayBenchmark(int games, uint64_t seed, int maxMoves) {
+    unsigned threads = min<unsigned>(configuredThreadCount(), max(1, games));
+    vector<SelfPlayResult> results(games);
+    atomic<int> next(0);
+
+    bool useMcts = AI_OPTIONS.engine == AIEngine::MCTS;
+    cout << "self-play (" << (useMcts ? "mcts" : "expectimax") << "): " << games << " games on "
+         << threads << " threads, seed " << seed;
+    if (maxMoves > 0) cout << ", at most " << maxMoves << " moves";
+    cout << endl;
+
+    shared_ptr<TranspositionTable> table = useMcts ? nullptr : openSharedTable();
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (int i = next++; i < games; i = next++) {
+                if (useMcts) {
+                    MCTSEngine engine;
+                    results[i] = playSelfPlayGame(engine, seed + i, maxMoves);
+                }
+                else {
+                    AIEvaluator evaluator(nullptr, table);
+                    results[i] = playSelfPlayGame(evaluator, seed + i, maxMoves);
+                }
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+    saveSharedTable(table);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<unsigned long long> scores;
+    unsigned long long moves = 0, nodes = 0;
+    double searchSeconds = 0.0;
+    map<int, int> maxTiles;
+    for (const auto& r : results) {
+        scores.push_back(r.score);
+        moves += r.moves;
+        nodes += r.nodes;
+        searchSeconds += r.seconds;
+        maxTiles[r.maxTile]++;
+    }
+    sort(scores.begin(), scores.end());
+    auto percentile = [&scores](double p) {
+        return scores[min(scores.size() - 1, static_cast<size_t>(p * scores.size()))];
+    };
+    double meanScore = accumulate(scores.begin(), scores.end(), 0.0) / games;
+
+    cout << "\nscore: min " << scores.front() << ", p10 " << percentile(0.1) << ", median " << percentile(0.5)
+         << ", p90 " << percentile(0.9) << ", max " << scores.back()
+         << ", mean " << fixed << setprecision(0) << meanScore << "\n";
+
+    cout << "\n" << setw(8) << "max tile" << setw(8) << "games" << setw(10) << "share" << setw(12) << "reached" << "\n";
+    int atLeast = games;
+    for (const auto& entry : maxTiles) {
+        cout << setw(8) << (1 << entry.first) << setw(8) << entry.second
+             << setw(9) << setprecision(1) << entry.second * 100.0 / games << "%"
+             << setw(11) << atLeast * 100.0 / games << "%\n";
+        atLeast -= entry.second;
+    }
+
+    cout << "\nwall time: " << setprecision(2) << wall << " s, moves: " << moves
+         << ", moves/sec: " << setprecision(1) << (wall > 0.0 ? moves / wall : 0.0) << "\n";
+    cout << "search nodes: " << nodes << ", nodes/sec: " << setprecision(0) << (wall > 0.0 ? nodes / wall : 0.0)
+         << " (per thread " << (searchSeconds > 0.0 ? nodes / searchSeconds : 0.0) << ")\n";
+}
+
+// 开局库生成：多线程自对弈，每局前plies步的局面按规范形式计数。
+// 已搜索过的局面直接沿用结果，因此越早的局面越便宜；最后只保留出现至少minCount次的局面
+void runBookBuild(const BookOptions& options) {
+    unsigned threads = static_cast<unsigned>(min<unsigned long long>(configuredThreadCount(), options.games));
+    struct Position {
+        OpeningBookEntry entry;
+        int count;
+    };
+    mutex positionsMutex;
+    unordered_map<uint64_t, Position> positions;
+    atomic<unsigned long long> next(0);
+    atomic<unsigned long long> searched(0), reused(0);
+
+    cout << "opening book: " << options.games << " games on " << threads << " threads, first "
+         << options.plies << " plies, seed " << options.seed << endl;
+
+    shared_ptr<TranspositionTable> table = openSharedTable();
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (unsigned long long i = next++; i < options.games; i = next++) {
+                AIEvaluator evaluator(nullptr, table);
+                mt19937_64 rng(options.seed + i);
+                uint64_t board = spawnRandomTile(spawnRandomTile(0, rng), rng);
+
+                for (int ply = 0; ply < options.plies; ply++) {
+                    int moveMap[4];
+                    uint64_t key = OpeningBook::canonicalize(board, moveMap);
+
+                    int move = -1;
+                    bool known = false;
+                    {
+                        lock_guard<mutex> lock(positionsMutex);
+                        auto it = positions.find(key);
+                        if (it != positions.end()) {
+                            it->second.count++;
+                            for (int m = 0; m < 4; m++) {
+                                if (moveMap[m] == it->second.entry.bestMove) move = m;
+                            }
+                            known = true;
+                        }
+                    }
+
+                    if (known) {
+                        reused++;
+                    }
+                    else {
+                        pair<int, vector<float>> best = evaluator.getBestMove(board);
+                        searched++;
+                        move = best.first;
+
+                        Position position;
+                        memset(&position.entry, 0, sizeof(position.entry));
+                        position.entry.board = key;
+                        position.entry.bestMove = move >= 0 ? moveMap[move] : -1;
+                        for (int m = 0; m < 4; m++) position.entry.scores[moveMap[m]] = best.second[m];
+                        position.count = 1;
+
+                        lock_guard<mutex> lock(positionsMutex);
+                        auto inserted = positions.emplace(key, position);
+                        if (!inserted.second) inserted.first->second.count++;
+                    }
+
+                    if (move < 0) break;
+                    uint64_t after = AIEvaluator::executeMove(move, board);
+                    if (after == board) break;
+                    board = spawnRandomTile(after, rng);
+                }
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+    saveSharedTable(table);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<OpeningBookEntry> entries;
+    for (const auto& entry : positions) {
+        if (entry.second.count >= options.minCount) entries.push_back(entry.second.entry);
+    }
+
+    cout << "positions: " << positions.size() << " distinct, " << searched.load() << " searched, "
+         << reused.load() << " reused; " << entries.size() << " seen at least " << options.minCount << " times\n";
+    cout << "wall time: " << fixed << setprecision(2) << wall << " s\n";
+
+    if (OpeningBook::save(options.outFile, entries)) {
+        cout << "saved " << entries.size() << " entries (" << entries.size() * sizeof(OpeningBookEntry) / 1024
+             << " KB) to " << options.outFile << endl;
+    }
+    else {
+        cerr << "Failed to save opening book: " << options.outFile << endl;
+    }
+}
+
+// 内核微基准：在真实对局采样的局面上重复调用单个内核，报告每次调用的耗时和吞吐量。
+// 结果累加进校验值，防止编译器把调用整个优化掉
+void runMicroBenchmark() {
+    vector<uint64_t> corpus = generateBoardCorpus(4096, 4242, 1);
+    vector<vector<vector<int>>> gridCorpus;
+    for (uint64_t board : corpus) {
+        vector<vector<int>> grid(4, vector<int>(4, 0));
+        for (int cell = 0; cell < 16; cell++) {
+            int rank = (board >> (4 * cell)) & 0xf;
+            grid[cell / 4][cell % 4] = rank ? 1 << rank : 0;
+        }
+        gridCorpus.push_back(grid);
+    }
+    const size_t count = corpus.size();
+    uint64_t checksum = 0;
+
+    cout << "boards: " << count << ", kernel: " << AIEvaluator::selectSimdKernels(AI_OPTIONS.simd) << "\n";
+    cout << setw(22) << "kernel" << setw(14) << "calls" << setw(10) << "ns/op" << setw(12) << "Mops/sec" << "\n";
+
+    // 每个内核至少运行0.2秒，按整轮语料计时
+    auto measure = [&](const char* name, auto&& body) {
+        unsigned long long calls = 0;
+        auto start = chrono::steady_clock::now();
+        double seconds = 0.0;
+        do {
+            for (size_t i = 0; i < count; i++) checksum += body(i);
+            calls += count;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2);
+        cout << setw(22) << name << setw(14) << calls << setw(10) << fixed << setprecision(2) << seconds * 1e9 / calls
+             << setw(12) << setprecision(1) << calls / seconds / 1e6 << "\n";
+    };
+
+    measure("executeMove", [&](size_t i) { return AIEvaluator::executeMove(static_cast<int>(i & 3), corpus[i]); });
+    measure("executeAllMoves (x4)", [&](size_t i) {
+        uint64_t out[4];
+        AIEvaluator::executeAllMoves(corpus[i], out);
+        return out[0] ^ out[1] ^ out[2] ^ out[3];
+    });
+    measure("transpose", [&](size_t i) { return AIEvaluator::transpose(corpus[i]); });
+    measure("countEmpty", [&](size_t i) { return static_cast<uint64_t>(AIEvaluator::countEmpty(corpus[i])); });
+    measure("countDistinctTiles", [&](size_t i) { return static_cast<uint64_t>(AIEvaluator::countDistinctTiles(corpus[i])); });
+    measure("scoreHeurBoard", [&](size_t i) { return static_cast<uint64_t>(AIEvaluator::scoreHeurBoard(corpus[i])); });
+    measure("scoreHeurBoards (x4)", [&](size_t i) {
+        float out[4];
+        AIEvaluator::scoreHeurBoards(&corpus[i & ~size_t(3)], out);
+        return static_cast<uint64_t>(out[i & 3]);
+    });
+    measure("convertToBitboard", [&](size_t i) { return AIEvaluator::convertToBitboard(gridCorpus[i]); });
+    if (auto network = sharedNTupleNetwork()) {
+        measure("NTupleNetwork::evaluate", [&](size_t i) { return static_cast<uint64_t>(network->evaluate(corpus[i])); });
+    }
+
+    // 整次搜索：固定深度下每个局面用新的评估器，置换表不跨局面复用
+    vector<uint64_t> searchCorpus = generateBoardCorpus(16, 777, 8);
+    int savedDepth = AI_OPTIONS.searchDepth;
+    cout << "\n" << setw(22) << "evaluateAllMoves" << setw(14) << "nodes" << setw(10) << "ms/op" << setw(12) << "Mnodes/sec" << "\n";
+    for (int depth = 1; depth <= 4; depth++) {
+        AI_OPTIONS.searchDepth = depth;
+        unsigned long long nodes = 0;
+        double seconds = 0.0;
+        for (uint64_t board : searchCorpus) {
+            AIEvaluator evaluator;
+            vector<float> scores = evaluator.evaluateAllMoves(board);
+            checksum += static_cast<uint64_t>(scores[0]);
+            nodes += evaluator.getLastStats().nodes;
+            seconds += evaluator.getLastStats().seconds;
+        }
+        cout << setw(16) << "depth " << depth << setw(14) << nodes << setw(10) << setprecision(2)
+             << seconds * 1e3 / searchCorpus.size()
+             << setw(12) << setprecision(2) << (seconds > 0.0 ? nodes / seconds / 1e6 : 0.0) << "\n";
+    }
+    AI_OPTIONS.searchDepth = savedDepth;
+
+    cout << "\nchecksum: " << hex << checksum << dec << "\n";
 }
 
 // 主函数
-int main() {
+int main(int argc, char* argv[]) {
+    // 命令行参数
+    bool searchBench = false;
+    bool microBench = false;
+    bool ttSizeGiven = false;
+    TrainOptions trainOptions;
+    TuneOptions tuneOptions;
+    BookOptions bookOptions;
+    uint64_t seed = 1;
+    int selfPlayGames = 0;
+    int selfPlayMaxMoves = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            AI_OPTIONS.threads = atoi(argv[++i]);
+        }
+        else if (arg == "--tt-mb" && i + 1 < argc) {
+            AI_OPTIONS.ttMegabytes = max(1, atoi(argv[++i]));
+            ttSizeGiven = true;
+        }
+        else if (arg == "--tt-file" && i + 1 < argc) {
+            AI_OPTIONS.ttFile = argv[++i];
+        }
+        else if (arg == "--move-time" && i + 1 < argc) {
+            AI_OPTIONS.moveTimeMs = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--move-nodes" && i + 1 < argc) {
+            AI_OPTIONS.moveNodes = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--no-ponder") {
+            AI_OPTIONS.ponder = false;
+        }
+        else if (arg == "--no-simd") {
+            AI_OPTIONS.simd = false;
+        }
+        else if (arg == "--no-leaf-batch") {
+            AI_OPTIONS.leafBatch = false;
+        }
+        else if (arg == "--tt-symmetry") {
+            AI_OPTIONS.ttSymmetry = true;
+        }
+        else if (arg == "--approx-mass" && i + 1 < argc) {
+            AI_OPTIONS.approxMass = max(0.0f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (arg == "--approx-cells" && i + 1 < argc) {
+            AI_OPTIONS.approxCells = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--prune") {
+            AI_OPTIONS.prune = true;
+        }
+        else if (arg == "--no-prune") {
+            AI_OPTIONS.prune = false;
+        }
+        else if (arg == "--ntuple" && i + 1 < argc) {
+            AI_OPTIONS.ntupleFile = argv[++i];
+        }
+        else if (arg == "--telemetry" && i + 1 < argc) {
+            AI_OPTIONS.telemetryFile = argv[++i];
+        }
+        else if (arg == "--depth" && i + 1 < argc) {
+            AI_OPTIONS.searchDepth = min(max(0, atoi(argv[++i])), 20);
+        }
+        else if (arg == "--search-bench") {
+            searchBench = true;
+        }
+        else if (arg == "--micro-bench") {
+            microBench = true;
+        }
+        else if (arg == "--train" && i + 1 < argc) {
+            trainOptions.games = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--train-out" && i + 1 < argc) {
+            trainOptions.outFile = argv[++i];
+        }
+        else if (arg == "--alpha" && i + 1 < argc) {
+            trainOptions.alpha = max(0.0f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (arg == "--lambda" && i + 1 < argc) {
+            trainOptions.lambda = min(max(0.0f, static_cast<float>(atof(argv[++i]))), 1.0f);
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc) {
+            trainOptions.checkpointGames = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--engine" && i + 1 < argc) {
+            string name = argv[++i];
+            if (name == "expectimax") AI_OPTIONS.engine = AIEngine::Expectimax;
+            else if (name == "mcts") AI_OPTIONS.engine = AIEngine::MCTS;
+            else {
+                cerr << "Unknown search engine: " << name << " (expected expectimax or mcts)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--book" && i + 1 < argc) {
+            AI_OPTIONS.bookFile = argv[++i];
+        }
+        else if (arg == "--book-build" && i + 1 < argc) {
+            bookOptions.games = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--book-out" && i + 1 < argc) {
+            bookOptions.outFile = argv[++i];
+        }
+        else if (arg == "--book-plies" && i + 1 < argc) {
+            bookOptions.plies = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--book-min-count" && i + 1 < argc) {
+            bookOptions.minCount = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--weights" && i + 1 < argc) {
+            string path = argv[++i];
+            if (!AI_OPTIONS.weights.load(path)) {
+                cerr << "Failed to load heuristic weights: " << path << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--selfplay" && i + 1 < argc) {
+            selfPlayGames = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--max-moves" && i + 1 < argc) {
+            selfPlayMaxMoves = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--tune" && i + 1 < argc) {
+            tuneOptions.generations = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--tune-pop" && i + 1 < argc) {
+            tuneOptions.population = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--tune-games" && i + 1 < argc) {
+            tuneOptions.gamesPerCandidate = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--tune-out" && i + 1 < argc) {
+            tuneOptions.outFile = argv[++i];
+        }
+    }
+    trainOptions.seed = seed;
+    tuneOptions.seed = seed;
+    bookOptions.seed = seed;
+
+    AIEvaluator::selectSimdKernels(AI_OPTIONS.simd);
+
+    // 无界面工具、n-tuple、开局库、MCTS和置换表都只支持4x4的64位棋盘，其他尺寸明确拒绝而不是悄悄忽略
+    if (BOARD_SIZE != 4) {
+        const char* unsupported = trainOptions.games > 0 ? "--train" : tuneOptions.generations > 0 ? "--tune" :
+            bookOptions.games > 0 ? "--book-build" : selfPlayGames > 0 ? "--selfplay" : searchBench ? "--search-bench" :
+            microBench ? "--micro-bench" : !AI_OPTIONS.ntupleFile.empty() ? "--ntuple" : !AI_OPTIONS.bookFile.empty() ? "--book" :
+            AI_OPTIONS.engine == AIEngine::MCTS ? "--engine mcts" : !AI_OPTIONS.ttFile.empty() ? "--tt-file" :
+            ttSizeGiven ? "--tt-mb" : nullptr;
+        if (unsupported) {
+            cerr << unsupported << " is only available in the 4x4 build (this build is " << BOARD_SIZE << "x" << BOARD_SIZE << ")" << endl;
+            return 1;
+        }
+    }
+
+    if (trainOptions.games > 0) {
+        runTdTraining(trainOptions);
+        return 0;
+    }
+
+    if (tuneOptions.generations > 0) {
+        runWeightTuning(tuneOptions);
+        return 0;
+    }
+
+    if (!AI_OPTIONS.ntupleFile.empty() && !sharedNTupleNetwork()) {
+        cerr << "Failed to load n-tuple network: " << AI_OPTIONS.ntupleFile << endl;
+        return 1;
+    }
+
+    if (bookOptions.games > 0) {
+        runBookBuild(bookOptions);
+        return 0;
+    }
+
+    if (!AI_OPTIONS.bookFile.empty() && !sharedOpeningBook()) {
+        cerr << "Failed to load opening book: " << AI_OPTIONS.bookFile << endl;
+        return 1;
+    }
+
+    if (selfPlayGames > 0) {
+        runSelfPlayBenchmark(selfPlayGames, seed, selfPlayMaxMoves);
+        return 0;
+    }
+
+    if (searchBench) {
+        runSearchBenchmark();
+        return 0;
+    }
+
+    if (microBench) {
+        runMicroBenchmark();
+        return 0;
+    }
+
 #ifdef _WIN32
     SetConsoleOutputCP(65001);
     SetConsoleCP(65001);
@@ -21,6 +21,14 @@
 #include <unordered_map>
 #include <math.h>
 #include <array>
+#include <thread>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <limits>
 
 // 跨平台头文件适配
 #ifdef _WIN32
@@ -33,18 +41,78 @@
 #include <termios.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+// x86平台的SIMD内核（运行时检测CPU特性后启用）
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AI_X86_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #endif
 
 using namespace std;
 
+// 棋盘边长在编译期选择（3到6），例如 -DGAME2048_BOARD_SIZE=5；4x4以外的尺寸由BoardEngine提供AI
+#ifndef GAME2048_BOARD_SIZE
+#define GAME2048_BOARD_SIZE 4
+#endif
+static_assert(GAME2048_BOARD_SIZE >= 3 && GAME2048_BOARD_SIZE <= 6, "board size must be between 3 and 6");
+
 // 全局常量
-extern const int MAX_UNDO_STEPS;
-extern const int BOARD_SIZE;
+constexpr int BOARD_SIZE = GAME2048_BOARD_SIZE;
 extern const int TARGET;
 extern const int CELL_WIDTH;
 extern const int CELL_HEIGHT;
 extern bool DEBUG;
 
+// 启发式评估权重，默认值对应编译期生成的评估表
+struct HeuristicWeights {
+    float lostPenalty = 200000.0f;
+    float monotonicityPower = 4.0f;
+    float monotonicityWeight = 47.0f;
+    float sumPower = 3.5f;
+    float sumWeight = 11.0f;
+    float mergesWeight = 700.0f;
+    float emptyWeight = 270.0f;
+
+    // 文本格式，每行“名称 值”，未出现的项保持原值
+    bool load(const string& path);
+    bool save(const string& path) const;
+    string toString() const;
+    bool operator==(const HeuristicWeights& other) const;
+};
+
+// 可选的搜索引擎
+enum class AIEngine { Expectimax, MCTS };
+
+// AI运行参数（可由命令行覆盖）
+struct AIOptions {
+    int threads = 0;            // 搜索线程数：0为全部硬件线程，1为串行搜索
+    int ttMegabytes = 64;       // 置换表内存预算（MB）
+    string ttFile;              // 置换表快照文件，启动时映射、退出时保存
+    int moveTimeMs = 0;         // 每步搜索时间预算（毫秒），0表示按固定深度搜索
+    unsigned long long moveNodes = 0;   // 每步搜索节点预算，0表示不限制
+    bool ponder = true;         // 空闲时预先搜索最佳着法之后可能出现的局面
+    bool simd = true;           // CPU支持时使用SIMD移动和评估内核
+    bool leafBatch = true;      // 最后一层的兄弟叶子合并为一批评估
+    bool ttSymmetry = false;    // 置换表按8种对称中的规范形式存取
+    float approxMass = 0.0f;    // 概率低于此值的机会节点近似展开，0为精确搜索
+    int approxCells = 4;        // 近似展开时最多采样的空格数
+    bool prune = false;         // 按估值上界剪掉不可能优于已知最佳着法的机会节点（需--prune开启）
+    string ntupleFile;          // n-tuple网络权重文件，设置后代替启发式评估叶子
+    int searchDepth = 0;        // 固定搜索深度，0为按局面自动选择
+    string telemetryFile;       // 每次提示的搜索统计以JSON行追加到此文件
+    string bookFile;            // 开局库文件，命中的局面不再搜索
+    AIEngine engine = AIEngine::Expectimax;     // 启动时使用的搜索引擎
+    HeuristicWeights weights;   // 新建评估器使用的启发式权重
+};
+extern AIOptions AI_OPTIONS;
+
 // 全局映射表
 extern std::map<int, int> _2PowerMap;
 extern std::map<int, int> _2logMap;
@@ -78,66 +146,528 @@ public:
     bool hasKeyPressed();
 };
 
+// 工作窃取线程池：每个线程维护自己的任务队列，空闲时从其他队列窃取
+class WorkStealingPool {
+private:
+    struct WorkerQueue {
+        mutex m;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues;   // 最后一个队列供池外线程提交任务
+    vector<thread> workers;
+    atomic<bool> stopping;
+    atomic<int> pendingTasks;
+    mutex sleepMutex;
+    condition_variable sleepCv;
+
+    static thread_local WorkStealingPool* currentPool;
+    static thread_local int currentIndex;
+
+    bool popTask(int self, function<void()>& task);
+    void workerLoop(int index);
+
+public:
+    explicit WorkStealingPool(unsigned threadCount);
+    ~WorkStealingPool();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // 当前线程在池中的编号，池外线程返回size()
+    int currentWorkerIndex() const {
+        return currentPool == this ? currentIndex : static_cast<int>(workers.size());
+    }
+
+    void submit(function<void()> task);
+
+    // 在当前线程执行一个待处理任务（等待子任务时用来帮忙）
+    bool runPendingTask();
+};
+
+// 一组并行任务，wait()期间当前线程会参与执行任务。
+// 没有可执行的任务时先短暂自旋，之后阻塞等待被窃取的任务完成，不再空转占满一个核
+class TaskGroup {
+private:
+    static constexpr int SPIN_ROUNDS = 64;
+    static constexpr int BLOCK_MICROSECONDS = 500;     // 阻塞期间定时醒来，帮忙执行新提交的任务
+
+    WorkStealingPool& pool;
+    atomic<int> pending;
+    mutex doneMutex;
+    condition_variable doneCv;
+
+public:
+    explicit TaskGroup(WorkStealingPool& p) : pool(p), pending(0) {}
+    ~TaskGroup() { wait(); }
+
+    void run(function<void()> task) {
+        pending++;
+        pool.submit([this, task = std::move(task)]() {
+            task();
+            // 持锁递减并通知，wait()返回前也要取得锁，保证通知结束后才析构
+            lock_guard<mutex> lock(doneMutex);
+            if (--pending == 0) doneCv.notify_all();
+        });
+    }
+
+    void wait() {
+        int idle = 0;
+        while (pending > 0) {
+            if (pool.runPendingTask()) {
+                idle = 0;
+            }
+            else if (++idle < SPIN_ROUNDS) {
+                this_thread::yield();
+            }
+            else {
+                unique_lock<mutex> lock(doneMutex);
+                doneCv.wait_for(lock, chrono::microseconds(BLOCK_MICROSECONDS), [this]() { return pending == 0; });
+            }
+        }
+        lock_guard<mutex> lock(doneMutex);
+    }
+};
+
+// 文件内存映射（写时复制，修改不会写回文件），也用于分配按需清零的匿名内存
+class MappedFile {
+private:
+    char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string& path);
+    bool allocate(size_t size);
+    void close();
+    void swap(MappedFile& other);
+
+    bool isOpen() const { return base != nullptr; }
+    char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// 置换表快照文件头，桶数据从第128字节开始
+struct TTFileHeader {
+    static constexpr uint32_t VERSION = 2;      // 第2版起条目可以是上界
+    static constexpr size_t BUCKET_OFFSET = 128;
+    static constexpr int MAX_PARAMS = 16;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t bucketSize;
+    uint64_t bucketCount;
+    uint32_t generation;
+    uint32_t paramCount;
+    float params[MAX_PARAMS];   // 生成快照时的评估参数，不一致则拒绝加载
+};
+
+// 无锁置换表：预分配的开放寻址表，每个桶占一个缓存行，按剩余深度优先替换
+// 条目的key字段保存 board ^ data，读到被并发写坏的条目时校验失败，无需加锁
+// 表在整局游戏中保留，每次搜索递增代数，旧代条目优先被替换
+class TranspositionTable {
+private:
+    static constexpr int BUCKET_ENTRIES = 4;
+    static constexpr uint64_t ENTRY_OCCUPIED = 1ULL << 63;
+    static constexpr uint64_t ENTRY_UPPER_BOUND = 1ULL << 48;  // 被Star1剪枝的节点只记录估值上界
+
+    struct Entry {
+        atomic<uint64_t> key;
+        atomic<uint64_t> data;  // 低32位为分数，32-39位为剩余深度，40-47位为代数，第48位为上界标记，最高位为占用标记
+    };
+
+    struct alignas(64) Bucket {
+        Entry entries[BUCKET_ENTRIES];
+    };
+
+    MappedFile ownedMemory;     // 匿名映射，页面首次访问时才由系统清零
+    MappedFile mapping;
+    Bucket* buckets;
+    size_t bucketMask;
+    atomic<uint8_t> generation;     // 共用一张表的多个评估器可能同时开始新搜索
+
+    static_assert(sizeof(Bucket) == 64, "bucket must fill one cache line");
+    static_assert(sizeof(atomic<uint64_t>) == sizeof(uint64_t), "entries are mapped from disk as raw words");
+
+    uint64_t packData(int depth, float score, bool upperBound) const;
+    static int depthOf(uint64_t data) { return static_cast<int>((data >> 32) & 0xff); }
+    static uint8_t generationOf(uint64_t data) { return static_cast<uint8_t>(data >> 40); }
+    // 代数只有8位，每256次搜索回绕一次，按模256的差值计算条目的年龄
+    int ageOf(uint64_t data) const { return static_cast<uint8_t>(generation - generationOf(data)); }
+    static float scoreOf(uint64_t data);
+
+    Bucket& bucketFor(uint64_t board) const {
+        // 位棋盘低位变化少，先混合再取模
+        uint64_t h = board;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return buckets[h & bucketMask];
+    }
+
+public:
+    explicit TranspositionTable(size_t megabytes);
+
+    // 命中且条目的剩余深度不小于depth时返回true，命中的旧代条目会被刷新为当前代。
+    // upperBound为true时score只是真实估值的上界
+    bool probe(uint64_t board, int depth, float& score, bool& upperBound);
+    // 同一局面只用更深的条目替换，同深度时上界不覆盖精确值
+    void store(uint64_t board, int depth, float score, bool upperBound = false);
+    void clear();
+
+    // 开始新一次搜索
+    void newSearch() { generation++; }
+
+    // 快照：params为评估参数，加载时必须与文件中记录的完全一致
+    bool loadSnapshot(const string& path, const vector<float>& params);
+    bool saveSnapshot(const string& path, const vector<float>& params);
+
+    size_t capacity() const { return (bucketMask + 1) * BUCKET_ENTRIES; }
+    double sampleOccupancy() const;
+};
+
+// n-tuple权重文件头，之后依次是每个元组的描述和全部权重（float，按元组顺序连续存放）
+struct NTupleFileHeader {
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int MAX_CELLS = 8;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t tupleCount;
+    uint32_t checksum;      // 权重数据的FNV-1a校验值，写入时计算，读取时不再遍历整个文件
+    uint32_t reserved;
+};
+
+struct NTupleFileTuple {
+    uint32_t cellCount;
+    uint32_t cells[NTupleFileHeader::MAX_CELLS];    // 格子编号 = 行 * 4 + 列
+};
+
+// n-tuple网络：每个元组是若干格子的组合，拥有一张16^n项的权重表，
+// 局面估值为所有元组在8种对称下查到的权重之和。权重文件直接内存映射，多个进程共享只读页面
+class NTupleNetwork {
+public:
+    // 权重直接映射自文件，与置换表条目一样按原子变量宽松读写，训练线程之间不加锁
+    struct Tuple {
+        vector<int> cells;
+        atomic<float>* weights;
+        size_t size;
+    };
+
+    static_assert(sizeof(atomic<float>) == sizeof(float), "weights are mapped from disk as raw floats");
+    static_assert(atomic<float>::is_always_lock_free, "weight updates must not take a lock");
+
+private:
+    vector<Tuple> tuples;
+    MappedFile mapping;         // 文件映射或按需清零的匿名内存
+    bool fileBacked = false;
+    uint32_t checksumValue = 0;
+
+    static bool validPattern(const vector<int>& cells);
+    static void symmetries(uint64_t board, uint64_t out[8]);
+
+public:
+    NTupleNetwork() = default;
+    NTupleNetwork(const NTupleNetwork&) = delete;
+    NTupleNetwork& operator=(const NTupleNetwork&) = delete;
+
+    bool create(const vector<vector<int>>& patterns);   // 全零权重
+    bool load(const string& path);
+    bool save(const string& path);                      // 同时更新checksum()
+
+    // 8种对称下的权重之和（不小于0的期望后续得分）
+    float evaluate(uint64_t board) const;
+    // 把delta加到局面在8种对称下命中的每个权重上（TD更新），并发的更新可能互相覆盖
+    void update(uint64_t board, float delta);
+    int featureCount() const { return static_cast<int>(tuples.size()) * 8; }
+
+    const vector<Tuple>& getTuples() const { return tuples; }
+    vector<Tuple>& getTuples() { return tuples; }
+    uint32_t checksum() const { return checksumValue; }
+
+    // 常用的4个6格元组
+    static vector<vector<int>> defaultPatterns();
+};
+
+// 按AI_OPTIONS.ntupleFile加载的网络，所有评估器共享；未设置或加载失败时返回空
+shared_ptr<const NTupleNetwork> sharedNTupleNetwork();
+
+// 开局库文件头，之后是按规范局面升序排列的条目
+struct OpeningBookHeader {
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t entryCount;
+};
+
+struct OpeningBookEntry {
+    uint64_t board;         // 8种对称中的规范形式
+    float scores[4];        // 规范局面下四个方向的得分，无效方向为0
+    int32_t bestMove;
+    uint32_t reserved;
+};
+
+// 开局库：常见早期局面预先搜索好的结果。文件直接内存映射，查询在映射上二分查找，启动时不解析
+class OpeningBook {
+private:
+    MappedFile mapping;
+    const OpeningBookEntry* entries = nullptr;
+    size_t count = 0;
+
+public:
+    OpeningBook() = default;
+    OpeningBook(const OpeningBook&) = delete;
+    OpeningBook& operator=(const OpeningBook&) = delete;
+
+    bool load(const string& path);
+    size_t size() const { return count; }
+
+    // 命中时按输入局面的朝向返回最佳移动和四个方向的得分
+    bool lookup(uint64_t bitboard, pair<int, vector<float>>& out) const;
+
+    // 条目按局面排序后写入（局面须已是规范形式且互不重复）
+    static bool save(const string& path, vector<OpeningBookEntry> entries);
+
+    // 返回局面的规范形式，moveMap[m]为原局面的移动m在规范局面下对应的方向
+    static uint64_t canonicalize(uint64_t board, int moveMap[4]);
+};
+
+// 按AI_OPTIONS.bookFile加载的开局库，所有分析共享；未设置或加载失败时返回空
+shared_ptr<const OpeningBook> sharedOpeningBook();
+
+// 搜索统计
+struct SearchStats {
+    unsigned long long nodes = 0;
+    unsigned long long cacheprobes = 0;
+    unsigned long long cachehits = 0;
+    int maxdepth = 0;
+    int completedDepth = 0;     // 迭代加深中最后完成的深度
+    double seconds = 0.0;
+    size_t ttEntries = 0;       // 置换表容量（条目数）
+    double ttFill = 0.0;        // 搜索结束时置换表的占用比例（抽样估计）
+    bool book = false;          // 结果直接取自开局库，没有搜索
+
+    double nodesPerSecond() const { return seconds > 0.0 ? nodes / seconds : 0.0; }
+    double cacheHitRate() const { return cacheprobes > 0 ? static_cast<double>(cachehits) / cacheprobes : 0.0; }
+};
+
+template <int N, int BITS = 4> class BoardEngine;
+
 // AI评估器类
 class AIEvaluator {
+    template <int N, int BITS> friend class BoardEngine;     // 共用行合并和启发式公式
+
 private:
-    unordered_map<uint64_t, pair<int, float>> transTable;
-
-    // 预计算表
-    static array<uint16_t, 65536> rowLeftTable;
-    static array<uint16_t, 65536> rowRightTable;
-    static array<uint64_t, 65536> colUpTable;
-    static array<uint64_t, 65536> colDownTable;
-    static array<float, 65536> heurScoreTable;
-    static array<float, 65536> scoreTable;
-
-    // 启发式评估参数
-    static constexpr float SCORE_LOST_PENALTY = 200000.0f;
-    static constexpr float SCORE_MONOTONICITY_POWER = 4.0f;
-    static constexpr float SCORE_MONOTONICITY_WEIGHT = 47.0f;
-    static constexpr float SCORE_SUM_POWER = 3.5f;
-    static constexpr float SCORE_SUM_WEIGHT = 11.0f;
-    static constexpr float SCORE_MERGES_WEIGHT = 700.0f;
-    static constexpr float SCORE_EMPTY_WEIGHT = 270.0f;
+    shared_ptr<TranspositionTable> transTable;  // 无界面对弈的评估器可以共用一张表
+    shared_ptr<const NTupleNetwork> network;    // 为空时使用启发式评估
+
+    // 本实例的启发式评估表：默认权重直接使用编译期的表，其他权重在运行时构建
+    HeuristicWeights heurWeights;
+    shared_ptr<const vector<float>> heurTableStorage;
+    const float* heurTable;
+    float heurUpperBound;
+
+    // 叶子评估接口：搜索按评估器类型实例化，默认的启发式路径没有额外开销
+    // HAS_REWARDS：估值只含未来收益，移动节点需加上本步合并得分；HAS_BOUND：存在全局上界，可以剪枝
+    struct HeuristicLeaf {
+        static constexpr bool HAS_REWARDS = false;
+        static constexpr bool HAS_BOUND = true;
+        const float* table;
+        float bound;
+        HeuristicLeaf(const float* t, float b) : table(t), bound(b) {}
+        float score(uint64_t board) const { return scoreHelper(board, table) + scoreHelper(transpose(board), table); }
+        void scoreBatch(const uint64_t* boards, float* out) const { leafKernel(boards, out, table); }
+        float upperBound() const { return bound; }
+    };
+
+    struct NTupleLeaf {
+        static constexpr bool HAS_REWARDS = true;
+        static constexpr bool HAS_BOUND = false;
+        const NTupleNetwork& net;
+        explicit NTupleLeaf(const NTupleNetwork& n) : net(n) {}
+        // 估值截断为非负，保证合法移动不会输给无效移动的0分
+        float score(uint64_t board) const { return max(0.0f, net.evaluate(board)); }
+        void scoreBatch(const uint64_t* boards, float* out) const {
+            for (int i = 0; i < 4; i++) out[i] = score(boards[i]);
+        }
+        float upperBound() const { return numeric_limits<float>::infinity(); }
+    };
+
+    // 并行搜索
+    WorkStealingPool* pool;
+    atomic<unsigned long long> statNodes;
+    atomic<unsigned long long> statCacheprobes;
+    atomic<unsigned long long> statCachehits;
+    atomic<int> statMaxdepth;
+    atomic<bool> statDepthLimited;  // 本轮是否有分支受深度限制（或命中了置换表）
+    SearchStats lastStats;
+
+    // 搜索预算与取消：第一轮迭代不受预算限制，保证总能返回结果
+    atomic<bool> aborted;
+    const atomic<bool>* cancelFlag;
+    bool limitsActive;
+    chrono::steady_clock::time_point deadline;
+
+    // 预计算表：编译期生成，位于只读数据段，启动时无需初始化且可在进程间共享页面
+    static const array<uint32_t, 65536> rowMoveTable;   // 低16位为左移差值，高16位为右移差值
+    static const array<uint64_t, 65536> colUpTable;
+    static const array<uint64_t, 65536> colDownTable;
+    static const array<float, 65536> heurScoreTable;
+    static const array<float, 65536> scoreTable;
+    static const float HEUR_UPPER_BOUND;    // 任意节点估值的上界（8行列表项最大值之和，且不小于0）
+
+    // 默认启发式评估参数，heurScoreTable在编译期按它生成
+    static constexpr HeuristicWeights DEFAULT_WEIGHTS{};
+    static_assert(DEFAULT_WEIGHTS.sumPower * 2 == static_cast<int>(DEFAULT_WEIGHTS.sumPower * 2) &&
+        DEFAULT_WEIGHTS.monotonicityPower * 2 == static_cast<int>(DEFAULT_WEIGHTS.monotonicityPower * 2),
+        "compile-time tables only support exponents that are multiples of 0.5");
 
     // 搜索参数
     static constexpr float CPROB_THRESH_BASE = 0.0001f;
     static constexpr int CACHE_DEPTH_LIMIT = 15;
+    static constexpr int PARALLEL_SPLIT_DEPTH = 2;      // 只在前两层机会节点拆分任务
+    static constexpr int PARALLEL_MIN_REMAINING = 2;    // 剩余深度不足时不再拆分
+    static constexpr int MAX_SEARCH_DEPTH = 20;         // 迭代加深的最大深度
+    static constexpr unsigned long ABORT_CHECK_INTERVAL = 4096;  // 每评估这么多次移动检查一次时间和取消
+    static constexpr float PRUNE_MARGIN = 1e-5f;        // 剪枝判断预留的相对误差，覆盖浮点累加的舍入
+    static constexpr int NTUPLE_SEARCH_DEPTH = 1;       // n-tuple估值已包含远期收益，浅层搜索即可
 
     struct EvalState {
-        unordered_map<uint64_t, pair<int, float>>& transTable;
+        TranspositionTable& transTable;
         int maxdepth = 0;
         int curdepth = 0;
+        bool depthLimited = false;
+        int cacheprobes = 0;
         int cachehits = 0;
         unsigned long moves_evaled = 0;
+        unsigned long moves_flushed = 0;
         int depth_limit = 0;
 
-        EvalState(unordered_map<uint64_t, pair<int, float>>& table) : transTable(table) {}
+        EvalState(TranspositionTable& table) : transTable(table) {}
+    };
+
+    static constexpr uint16_t reverseRow(uint16_t row);
+    static constexpr uint64_t unpackCol(uint16_t row);
+    static constexpr double constPow(double base, double exponent);
+    static constexpr uint16_t moveRowLeft(uint16_t row);
+    template <int Cells, unsigned MaxRank = 0xf>
+    static constexpr void mergeLineLeft(unsigned* line);
+    static constexpr float rowScore(uint16_t row);
+    // 启发式用到的各阶方块的幂，按权重预先算好（覆盖每格5位的宽棋盘）
+    struct HeurPowers {
+        static constexpr int RANKS = 32;
+        double sum[RANKS];
+        double monotonicity[RANKS];
     };
+    static const HeurPowers DEFAULT_POWERS;
+    template <typename PowFunc>
+    static constexpr HeurPowers heurPowers(const HeuristicWeights& weights, PowFunc power);
+    static constexpr float heurRowScore(uint16_t row, const HeuristicWeights& weights, const HeurPowers& powers);
+    template <int Cells>
+    static constexpr float heurLineScore(const int* line, const HeuristicWeights& weights, const HeurPowers& powers);
+    static HeurPowers runtimeHeurPowers(const HeuristicWeights& weights);
+    static float upperBoundOf(const float* table);
+    void buildHeuristicTable(const HeuristicWeights& weights);
+    template <typename T, size_t Count = 65536, typename RowFunc>
+    static constexpr array<T, Count> buildTable(RowFunc rowFunc, unsigned firstRow = 0);
 
-    static uint16_t reverseRow(uint16_t row);
-    static uint64_t unpackCol(uint16_t row);
+    // 四方向移动内核和批量叶子评估内核，启动时按CPU特性选择实现
+    typedef void (*AllMovesKernel)(uint64_t board, uint64_t* out);
+    typedef void (*LeafKernel)(const uint64_t* boards, float* out, const float* table);
+    static AllMovesKernel allMovesKernel;
+    static LeafKernel leafKernel;
+    static void executeAllMovesScalar(uint64_t board, uint64_t* out);
+    static void scoreHeurBoardsScalar(const uint64_t* boards, float* out, const float* table);
+#ifdef AI_X86_SIMD
+    static void executeAllMovesAvx2(uint64_t board, uint64_t* out);
+    static void scoreHeurBoardsAvx2(const uint64_t* boards, float* out, const float* table);
+#endif
+    static bool cpuSupportsAvx2();
+    static float scoreHelper(uint64_t board, const float* table);
+
+    void flushStats(const EvalState& state);
+    bool checkAbort(EvalState& state);
+
+    template <class Leaf>
+    float scoreTileChooseNode(EvalState& state, const Leaf& leaf, uint64_t board, float cprob, float alpha);
+    template <class Leaf>
+    float scoreSpawnsParallel(EvalState& state, const Leaf& leaf, uint64_t board, float cprob, int num_open);
+    template <class Leaf>
+    float scoreSpawnsSampled(EvalState& state, const Leaf& leaf, uint64_t board, float cprob, int num_open);
+    template <class Leaf>
+    float scoreMoveNode(EvalState& state, const Leaf& leaf, uint64_t board, float cprob);
+    template <class Leaf>
+    float scoreTopLevelMove(const Leaf& leaf, uint64_t board, int move, int depth);
+    template <class Leaf>
+    vector<float> searchRoot(const Leaf& leaf, uint64_t board, int depth);
+
+public:
+    explicit AIEvaluator(WorkStealingPool* searchPool = nullptr, size_t ttMegabytes = AI_OPTIONS.ttMegabytes);
+    // table为空时分配自己的表
+    AIEvaluator(WorkStealingPool* searchPool, shared_ptr<TranspositionTable> table);
+
+    // 位棋盘基础运算
     static uint64_t transpose(uint64_t x);
+    static uint64_t flipHorizontal(uint64_t x);
+    static uint64_t flipVertical(uint64_t x);
+    static uint64_t canonicalBoard(uint64_t x);
     static int countEmpty(uint64_t x);
-    static float scoreHelper(uint64_t board, const array<float, 65536>& table);
     static float scoreHeurBoard(uint64_t board);
 
-    float scoreTileChooseNode(EvalState& state, uint64_t board, float cprob);
-    float scoreMoveNode(EvalState& state, uint64_t board, float cprob);
-    float scoreTopLevelMove(uint64_t board, int move);
+    // 一步移动的合并得分
+    static float moveReward(uint64_t before, uint64_t after) {
+        return scoreHelper(after, scoreTable.data()) - scoreHelper(before, scoreTable.data());
+    }
 
-public:
-    // 初始化预计算表
-    static void initTables();
+    // 更换叶子评估器（空指针恢复启发式），置换表随之清空
+    void setNetwork(shared_ptr<const NTupleNetwork> net);
+
+    // 更换本实例的启发式权重并重建评估表，置换表随之清空
+    void setHeuristicWeights(const HeuristicWeights& weights);
+    const HeuristicWeights& getHeuristicWeights() const { return heurWeights; }
+    bool usesNetwork() const { return network != nullptr; }
 
     // 执行移动
     static uint64_t executeMove(int move, uint64_t board);
 
+    // 一次算出上下左右四个方向移动后的棋盘（共用一次转置），结果按移动编号存入out
+    static void executeAllMoves(uint64_t board, uint64_t out[4]) { allMovesKernel(board, out); }
+
+    // 批量计算四个棋盘的启发式评分，结果与逐个调用scoreHeurBoard逐位一致
+    static void scoreHeurBoards(const uint64_t boards[4], float out[4]) { leafKernel(boards, out, heurScoreTable.data()); }
+
+    // 启用或关闭SIMD内核（CPU不支持时保持标量实现），返回当前内核名称
+    static const char* selectSimdKernels(bool useSimd);
+
     // 评估四个方向的得分
-    vector<float> evaluateAllMoves(const vector<vector<int>>& board);
+    // 设置了时间或节点预算时迭代加深，返回最后完成深度的结果；cancel被置位后1毫秒内返回
+    vector<float> evaluateAllMoves(const vector<vector<int>>& board, const atomic<bool>* cancel = nullptr);
+    vector<float> evaluateAllMoves(uint64_t bitboard, const atomic<bool>* cancel = nullptr);
 
     // 获取最佳移动建议
-    pair<int, vector<float>> getBestMove(const vector<vector<int>>& board);
+    pair<int, vector<float>> getBestMove(const vector<vector<int>>& board, const atomic<bool>* cancel = nullptr);
+    pair<int, vector<float>> getBestMove(uint64_t bitboard, const atomic<bool>* cancel = nullptr);
+
+    // 最近一次搜索的统计数据
+    const SearchStats& getLastStats() const { return lastStats; }
+
+    // 置换表快照（参数校验见snapshotParams）
+    bool loadTableSnapshot(const string& path);
+    bool saveTableSnapshot(const string& path);
+    vector<float> snapshotParams() const;
 
     // 棋盘表示转换函数
     static uint64_t convertToBitboard(const vector<vector<int>>& board);
@@ -165,12 +695,346 @@ public:
     }
 };
 
+// 任意边长棋盘的位表示：每格BITS位，每行占一个BITS*N位的字。
+// 整个棋盘放得进64位时打包成一个整数，否则每行一个32位字
+template <int N, int BITS, bool Packed = (N * N * BITS <= 64)>
+struct BoardPacking {
+    typedef array<uint32_t, N> Board;
+
+    static uint32_t getRow(const Board& board, int row) { return board[row]; }
+    static void setRow(Board& board, int row, uint32_t value) { board[row] = value; }
+
+    struct Hash {
+        size_t operator()(const Board& board) const {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for (uint32_t row : board) h = (h ^ row) * 0x100000001b3ULL;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+};
+
+template <int N, int BITS>
+struct BoardPacking<N, BITS, true> {
+    typedef uint64_t Board;
+    static constexpr int ROW_BITS = BITS * N;
+    static constexpr uint64_t ROW_MASK = (1ULL << ROW_BITS) - 1;
+
+    static uint32_t getRow(Board board, int row) { return static_cast<uint32_t>((board >> (ROW_BITS * row)) & ROW_MASK); }
+    static void setRow(Board& board, int row, uint32_t value) {
+        board = (board & ~(ROW_MASK << (ROW_BITS * row))) | (static_cast<uint64_t>(value) << (ROW_BITS * row));
+    }
+
+    typedef hash<uint64_t> Hash;
+};
+
+// 任意边长、任意格宽的位棋盘引擎，与AIEvaluator最初的串行期望最大搜索同构。
+// 4位的4x4仍由AIEvaluator负责，这里在编译期选择打包方式和行表：
+// 其他边长用4位；出现32768及以上的方块时改用5位（4x4为4个20位的行，共128位），可以继续合并到2^31。
+// 行宽不超过20位时行表在首次使用时构建，更宽的行（如6x6）逐行现算
+template <int N, int BITS>
+class BoardEngine {
+public:
+    typedef BoardPacking<N, BITS> Packing;
+    typedef typename Packing::Board Board;
+    static constexpr int CELLS = N * N;
+    static constexpr unsigned CELL_MASK = (1u << BITS) - 1;
+    static constexpr bool ROW_TABLES = N * BITS <= 20;
+    static_assert(N * BITS <= 32 && BITS <= 5, "a row must fit in 32 bits and ranks in the heuristic tables");
+
+private:
+    struct RowTables {
+        vector<uint32_t> left;
+        vector<uint32_t> right;
+        vector<float> heur;
+        vector<double> score;
+    };
+
+    struct EvalState {
+        unordered_map<Board, pair<int, float>, typename Packing::Hash> transTable;
+        int maxdepth = 0;
+        int curdepth = 0;
+        int depthLimit = 0;
+        unsigned long long nodes = 0;
+        unsigned long long cacheprobes = 0;
+        unsigned long long cachehits = 0;
+    };
+
+    SearchStats lastStats;
+    const atomic<bool>* cancelFlag = nullptr;
+    bool aborted = false;
+
+    static constexpr float CPROB_THRESH_BASE = 0.0001f;
+    static constexpr int CACHE_DEPTH_LIMIT = 15;
+
+    static const RowTables& rowTables();
+    static const AIEvaluator::HeurPowers& heurPowers();
+    static uint32_t reverseRow(uint32_t row);
+    static uint32_t moveRowLeft(uint32_t row);
+    static float heurRowScore(uint32_t row);
+    static double tileRowScore(uint32_t row);
+    static uint32_t rowLeft(uint32_t row);
+    static uint32_t rowRight(uint32_t row);
+    static float rowHeur(uint32_t row);
+    static double rowScore(uint32_t row);
+
+    float scoreTileChooseNode(EvalState& state, const Board& board, float cprob);
+    float scoreMoveNode(EvalState& state, const Board& board, float cprob);
+
+public:
+    // 超出格宽的方块截断为最大阶
+    static Board convertToBitboard(const vector<vector<int>>& board);
+    static int getCell(const Board& board, int row, int col) { return (Packing::getRow(board, row) >> (BITS * col)) & CELL_MASK; }
+    static Board transpose(const Board& board);
+    static Board executeMove(int move, const Board& board);
+    static int countEmpty(const Board& board);
+    static int countDistinctTiles(const Board& board);
+    static float scoreHeurBoard(const Board& board);
+
+    // 一步移动的合并得分（与AIEvaluator::moveReward相同，取两个局面的方块得分之差）
+    static double moveReward(const Board& before, const Board& after);
+
+    // 固定深度搜索（--depth，默认按不同方块数选择）；cancel被置位后尽快返回
+    pair<int, vector<float>> getBestMove(const vector<vector<int>>& board, const atomic<bool>* cancel = nullptr);
+    const SearchStats& getLastStats() const { return lastStats; }
+};
+
+// 4位的棋盘无法合并两个32768，出现32768及以上的方块时分析改用5位的BoardEngine
+bool needsWideBoard(const vector<vector<int>>& board);
+
+// 蒙特卡洛树搜索引擎：所有线程共享一棵树，经过的节点先记虚拟损失，使并发的模拟分散到不同分支。
+// 决策节点按UCB1选择移动，机会节点随机抽样出块，新叶子用启发式贪心策略走子模拟并累计合并得分
+class MCTSEngine {
+private:
+    struct ChanceNode;
+
+    struct DecisionNode {
+        atomic<int64_t> totalValue;
+        atomic<int32_t> visits;
+        atomic<ChanceNode*> moves[4];
+        DecisionNode();
+    };
+
+    struct ChanceNode {
+        atomic<int64_t> totalValue;
+        atomic<int32_t> visits;
+        atomic<DecisionNode*> spawns[32];   // 下标为 格子 * 2 + (出4 ? 1 : 0)
+        ChanceNode();
+    };
+
+    // 每个线程从自己的区域分配节点，deque扩容不移动已有元素，搜索结束后统一释放
+    struct Arena {
+        deque<DecisionNode> decisions;
+        deque<ChanceNode> chances;
+    };
+
+    WorkStealingPool* pool;
+    deque<Arena> arenas;
+    SearchStats lastStats;
+
+    static constexpr int VIRTUAL_LOSS = 3;          // 下降时预记的访问次数，回传时扣回
+    static constexpr double EXPLORATION = 0.5;      // UCB探索系数，按兄弟节点的最大均值缩放
+    static constexpr int ROLLOUT_MOVES = 100;       // 模拟走子的步数上限
+    static constexpr int MAX_TREE_DEPTH = 256;
+    static constexpr int DEFAULT_TIME_MS = 100;     // 未设置任何预算时的每步时间
+
+    template <typename Node>
+    static Node* expand(atomic<Node*>& slot, deque<Node>& storage);
+    int simulate(DecisionNode* root, uint64_t board, Arena& arena, mt19937_64& rng);
+    static int64_t rollout(uint64_t board, mt19937_64& rng);
+
+public:
+    explicit MCTSEngine(WorkStealingPool* searchPool = nullptr);
+    MCTSEngine(const MCTSEngine&) = delete;
+    MCTSEngine& operator=(const MCTSEngine&) = delete;
+
+    // 预算为--move-time（默认100毫秒）或--move-nodes（模拟次数）；cancel被置位后尽快返回
+    // 得分为各方向的平均后续得分（含本步合并得分），无效方向为0；最佳移动取访问次数最多的方向
+    pair<int, vector<float>> getBestMove(uint64_t bitboard, const atomic<bool>* cancel = nullptr);
+
+    // 最近一次搜索的统计：nodes为模拟次数，maxdepth为树的最大深度
+    const SearchStats& getLastStats() const { return lastStats; }
+};
+
+// 配置的搜索线程数（--threads，0表示全部硬件线程）
+unsigned configuredThreadCount();
+
+// AI分析服务：常驻线程处理分析请求，搜索使用固定大小的工作窃取线程池
+// 请求队列只保留最新的一个，新请求到来时取消正在进行的旧搜索
+class AIAnalysisService {
+public:
+    struct Result {
+        uint64_t requestId = 0;
+        int bestMove = -1;
+        vector<float> scores;
+        SearchStats stats;
+        bool pondered = false;  // 结果来自后台预搜索
+    };
+
+private:
+    unique_ptr<WorkStealingPool> pool;
+    AIEvaluator evaluator;
+    unique_ptr<MCTSEngine> mcts;    // 首次选用时在服务线程中创建
+    shared_ptr<const OpeningBook> book;     // 命中开局库的局面不再搜索
+    BoardEngine<BOARD_SIZE> sizedEngine;        // 4x4以外的尺寸使用，请求直接携带棋盘
+    BoardEngine<BOARD_SIZE, 5> wideEngine;      // 出现32768及以上的方块时使用（见needsWideBoard）
+    AIEngine engine;                // 受m保护，请求开始时读取
+
+    mutex m;
+    condition_variable cv;
+    condition_variable resultCv;
+    thread dispatcher;
+    bool stopping;
+    bool hasRequest;
+    uint64_t pendingBoard;
+    vector<vector<int>> pendingGrid;
+    uint64_t nextId;
+    uint64_t latestId;      // 最新请求编号，较早的结果一律丢弃
+    uint64_t activeId;      // 正在搜索的请求编号，0表示空闲
+    bool pondering;         // 正在搜索预测局面
+    uint64_t ponderBoard;   // 正在预搜索的局面
+    uint64_t adoptedId;     // 被预搜索接管的请求编号，0表示无
+    atomic<bool> cancelFlag;
+    bool hasResult;
+    Result result;
+
+    // 预搜索：最佳着法后的局面按出块概率展开，结果缓存到真实请求到来
+    bool ponderEnabled;
+    deque<uint64_t> ponderQueue;
+    unordered_map<uint64_t, Result> ponderCache;
+
+    void run();
+    uint64_t submitRequest(uint64_t bitboard, vector<vector<int>>&& grid);
+    pair<int, vector<float>> search(AIEngine which, uint64_t board, const vector<vector<int>>& grid, SearchStats& stats);
+    void startPonder(uint64_t board, int bestMove);
+    void publish(Result&& res);
+
+public:
+    explicit AIAnalysisService(unsigned threads, bool ponder = AI_OPTIONS.ponder);
+    ~AIAnalysisService();
+
+    // 提交分析请求，返回请求编号；4x4的普通局面可以直接提交位棋盘
+    uint64_t submit(const vector<vector<int>>& board);
+    uint64_t submit(uint64_t bitboard);
+
+    // 取消排队和正在进行的请求（不阻塞）
+    void cancel();
+
+    // 取出最新请求的结果
+    bool poll(Result& out);
+
+    // 等待最新请求的结果就绪，超时返回false
+    bool waitResult(int timeoutMs);
+
+    // 切换搜索引擎，对之后提交的请求生效；已缓存的预搜索结果作废
+    void setEngine(AIEngine newEngine);
+    AIEngine getEngine();
+
+    // 停止服务线程，析构时自动调用
+    void shutdown();
+
+    // 置换表快照，只应在服务空闲或停止后调用
+    bool loadTableSnapshot(const string& path) { return evaluator.loadTableSnapshot(path); }
+    bool saveTableSnapshot(const string& path) { return evaluator.saveTableSnapshot(path); }
+};
+
+// 4位棋盘的走子和合并得分：4x4使用AIEvaluator的编译期行表，其他边长使用BoardEngine
+template <int N> struct NarrowBoardEngine { typedef BoardEngine<N> type; };
+template <> struct NarrowBoardEngine<4> { typedef AIEvaluator type; };
+
+// 游戏的棋盘状态，数值只在绘制、存档和提交分析时解码，走子不分配内存。
+// 平时每格4位（4x4即AIEvaluator的64位棋盘）；出现32768及以上的方块后换成每格5位，两个32768才能继续合并
+class GameBoard {
+private:
+    typedef BoardPacking<BOARD_SIZE, 4> NarrowPacking;
+    typedef NarrowBoardEngine<BOARD_SIZE>::type NarrowEngine;
+    typedef BoardEngine<BOARD_SIZE, 5> WideEngine;
+    static constexpr int WIDE_RANK = 15;    // 4位棋盘中出现这一阶时改用5位
+
+    NarrowPacking::Board narrow;
+    WideEngine::Board wideBoard;
+    bool isWide;
+
+    void widen();
+
+public:
+    GameBoard();
+    static GameBoard fromGrid(const vector<vector<int>>& grid);
+    vector<vector<int>> toGrid() const;
+
+    // 格子的阶（0为空）和数值
+    int getRank(int row, int col) const;
+    int get(int row, int col) const { int rank = getRank(row, col); return rank ? 1 << rank : 0; }
+    // value为0或2的幂
+    void set(int row, int col, int value);
+
+    // 移动编号与AIEvaluator相同：0上 1下 2左 3右；棋盘不变时返回false，合并得分累加到score
+    bool move(int direction, int& score);
+    bool canMove() const;
+    int countEmpty() const;
+    // 按行优先把第index个空格设为value
+    void placeInEmpty(int index, int value);
+    int maxTile() const;
+    bool hasTile(int value) const;
+
+    bool operator==(const GameBoard& other) const {
+        return isWide == other.isWide && (isWide ? wideBoard == other.wideBoard : narrow == other.narrow);
+    }
+
+    // 4x4的4位棋盘可以直接交给AIEvaluator
+    bool hasBitboard() const { return BOARD_SIZE == 4 && !isWide; }
+    uint64_t bitboard() const;
+};
+
+// 撤销/重做历史：走过的局面连同分数组成一棵树，节点按块分配且从不移动，撤销和重做只移动当前位置。
+// 撤销后走出不同的局面会在此分叉，旧分支保留，重做默认回到最近走过的分支
+class GameHistory {
+private:
+    static constexpr uint32_t NONE = numeric_limits<uint32_t>::max();
+    static constexpr uint32_t CHUNK_SIZE = 4096;
+
+    struct Entry {
+        GameBoard board;
+        int score = 0;
+        int highScore = 0;      // 撤销后不再计入被撤销的得分
+        bool won = false;
+        uint32_t parent = NONE;
+        uint32_t firstChild = NONE;     // 子节点按创建顺序倒序链接
+        uint32_t nextSibling = NONE;
+        uint32_t redoChild = NONE;      // 重做时前往的分支
+    };
+
+    vector<unique_ptr<Entry[]>> chunks;     // 重置时保留，之后的对局不再分配
+    uint32_t count;
+    uint32_t current;
+
+    Entry& at(uint32_t index) { return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+    const Entry& at(uint32_t index) const { return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+
+public:
+    GameHistory() : count(0), current(NONE) {}
+
+    // 清空历史，以给定局面为根
+    void reset(const GameBoard& board, int score, int highScore, bool won);
+    // 记录走完一步（含出块）后的局面；与已有分支相同时直接进入该分支
+    void record(const GameBoard& board, int score, int highScore, bool won);
+
+    // 成功时写回局面、分数、最高分和获胜标记
+    bool undo(GameBoard& board, int& score, int& highScore, bool& won);
+    bool redo(GameBoard& board, int& score, int& highScore, bool& won);
+
+    // 把重做目标换成当前局面的下一个分支，返回新目标的序号（从1开始），分支少于两个时返回0
+    int switchBranch();
+    int branchCount() const;
+
+    size_t size() const { return count; }
+};
+
 // 2048游戏主类
 class Game2048 {
 private:
     // 游戏核心数据
-    vector<vector<int>> board;
-    vector<vector<int>> prevBoard;
+    GameBoard board;
+    GameBoard prevBoard;
     int score;
     int prevScore;
     int highScore;
@@ -178,8 +1042,7 @@ private:
 
     // 练习模式相关变量
     bool practiceMode;
-    vector<vector<vector<int>>> practiceHistory;
-    vector<int> practiceHistoryScores;
+    GameHistory history;        // 普通模式和练习模式共用，进入练习模式时重置
     int forcedSpawnNum;
     int forcedSpawnX;
     int forcedSpawnY;
@@ -198,16 +1061,18 @@ private:
     map<string, string> chineseStrings, englishStrings;
 
     // AI相关变量
-    AIEvaluator aiEvaluator;
+    AIAnalysisService aiService;
+    uint64_t aiRequestId;
     vector<float> moveScores;
     int aiBestMove;
     bool openAI;
     bool aiAutoMode;
     int aiAutoMoveDelay;
     atomic<bool> aiEvaluating;
-    atomic<bool> aiCancelFlag;
-    future<pair<int, vector<float>>> aiFuture;
     mutex aiMutex;
+    SearchStats aiStats;
+    ofstream telemetryOut;      // --telemetry日志，首次写入时打开
+    bool aiPondered;
 
     // 键盘处理器
     KeyboardHandler keyboard;
@@ -218,6 +1083,7 @@ private:
 public:
     // 构造函数
     Game2048();
+    ~Game2048();
 
     // 游戏主循环
     void play();
@@ -235,8 +1101,7 @@ private:
     // 游戏逻辑函数
     void initBoard();
     void addRandomTile();
-    void rotateBoard();
-    bool moveRowLeft(vector<int>& row);
+    bool moveBoard(int direction);
     bool moveLeft();
     bool moveRight();
     bool moveUp();
@@ -247,8 +1112,10 @@ private:
 
     // 练习模式函数
     void enterPracticeMode();
-    void savePracticeState();
-    bool undoPractice();
+    bool undoMove();
+    bool redoMove();
+    void switchRedoBranch();
+    bool offerUndoAfterGameOver();
     void handleForcedSpawnInput();
 
     // AI相关函数
@@ -281,7 +1148,61 @@ private:
     bool loadGame();
 };
 
+// 无界面工具
+uint64_t spawnRandomTile(uint64_t board, mt19937_64& rng);
+vector<uint64_t> generateBoardCorpus(size_t count, uint64_t seed, int minDistinct);
+void runSearchBenchmark();
+void runMicroBenchmark();
+
+// 一次分析的统计记录（单行JSON），附带局面特征便于离线关联
+string searchStatsJson(const vector<vector<int>>& board, const SearchStats& stats, int bestMove, bool pondered);
+void runApproximationReport(const vector<uint64_t>& corpus);
+
+// TD自对弈训练参数
+struct TrainOptions {
+    unsigned long long games = 0;
+    string outFile = "ntuple.bin";
+    float alpha = 0.1f;                             // 学习率，按特征数平分到每个权重
+    float lambda = 0.0f;                            // 0为TD(0)，大于0时对整局做λ-回报的反向更新
+    unsigned long long checkpointGames = 10000;     // 每隔多少局输出统计并保存权重
+    uint64_t seed = 1;
+};
+void runTdTraining(const TrainOptions& options);
+
+// 用评估器的最佳移动自对弈一局，maxMoves为0时下到无路可走
+struct SelfPlayResult {
+    unsigned long long score = 0;
+    int maxTile = 0;                // 最大方块的指数
+    int moves = 0;
+    unsigned long long nodes = 0;
+    double seconds = 0.0;
+};
+SelfPlayResult playSelfPlayGame(AIEvaluator& evaluator, uint64_t seed, int maxMoves = 0);
+SelfPlayResult playSelfPlayGame(MCTSEngine& engine, uint64_t seed, int maxMoves = 0);
+
+// 启发式权重调优参数（对数空间的对角协方差CMA-ES，适应度为固定种子对局的平均得分）
+struct TuneOptions {
+    int generations = 0;
+    int population = 0;             // 0为按维数自动选择
+    int gamesPerCandidate = 8;
+    float sigma = 0.3f;             // 初始步长（对数空间）
+    string outFile = "weights.txt";
+    uint64_t seed = 1;
+};
+void runWeightTuning(const TuneOptions& options);
+void runSelfPlayBenchmark(int games, uint64_t seed, int maxMoves);
+
+// 开局库生成参数：自对弈前plies步遇到的局面中，出现至少minCount次的写入开局库
+struct BookOptions {
+    unsigned long long games = 0;
+    int plies = 200;
+    int minCount = 2;
+    string outFile = "book.bin";
+    uint64_t seed = 1;
+};
+void runBookBuild(const BookOptions& options);
+
 // 主函数声明
-int main();
+int main(int argc, char* argv[]);
 
 #endif // GAME2048_H
\ No newline at end of file